@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L	/* fork, waitpid */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "analyse.h"
+#include "parser.h"
+
+/* Longueur maximale d'un chemin transmis au verificateur */
+#define CHEMIN_MAX 4096
+
+/* L'analyseur (flex/bison) garde son etat dans des globales ; le verrou
+ * protege aussi le dialogue avec le verificateur */
+static pthread_mutex_t verrou_analyseur = PTHREAD_MUTEX_INITIALIZER;
+
+/* Verificateur (cf. demarrer_verification) : tubes des requetes et des
+ * reponses, -1 s'il n'est pas lance */
+static pid_t verificateur = -1;
+static int vers_verificateur = -1, depuis_verificateur = -1;
+
+
+/* Analyse de l'expression du fichier chemin dans un processus fils, qui
+ * peut se terminer sans dommage. Retourne 1 si elle est correcte, 0 sinon. */
+static int verifier(const char *chemin)
+{
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t fils = fork();
+	if (fils < 0)
+		return 0;
+
+	if (fils == 0) {
+		struct noeud_ast *ast;
+		analyser((unsigned char *) chemin, &ast);
+		_exit(ast != NULL ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	int etat;
+	while (waitpid(fils, &etat, 0) < 0) {
+		if (errno != EINTR)
+			return 0;
+	}
+
+	return WIFEXITED(etat) && WEXITSTATUS(etat) == EXIT_SUCCESS;
+}
+
+
+/* Lecture et ecriture completes de n octets. Retournent 0, ou -1. */
+static int lire_tout(int fd, void *octets, size_t n)
+{
+	while (n > 0) {
+		ssize_t k = read(fd, octets, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+			return -1;
+		octets = (unsigned char *) octets + k;
+		n -= (size_t) k;
+	}
+
+	return 0;
+}
+
+static int ecrire_tout(int fd, const void *octets, size_t n)
+{
+	while (n > 0) {
+		ssize_t k = write(fd, octets, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			return -1;
+		octets = (const unsigned char *) octets + k;
+		n -= (size_t) k;
+	}
+
+	return 0;
+}
+
+
+/* Boucle du verificateur : un chemin (sa longueur puis ses octets) par
+ * requete, un octet de reponse (1 : expression correcte). Se termine a la
+ * fermeture du tube des requetes. */
+static void servir_verifications(int requetes, int reponses)
+{
+	char chemin[CHEMIN_MAX];
+	size_t n;
+
+	while (lire_tout(requetes, &n, sizeof (n)) == 0 && n < sizeof (chemin)
+	       && lire_tout(requetes, chemin, n) == 0) {
+		chemin[n] = '\0';
+		unsigned char correcte = (unsigned char) verifier(chemin);
+		if (ecrire_tout(reponses, &correcte, 1) != 0)
+			break;
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+
+int demarrer_verification(void)
+{
+	int requetes[2], reponses[2];
+	if (pipe(requetes) != 0)
+		return -1;
+	if (pipe(reponses) != 0) {
+		close(requetes[0]);
+		close(requetes[1]);
+		return -1;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(requetes[1]);
+		close(reponses[0]);
+		servir_verifications(requetes[0], reponses[1]);
+	}
+
+	close(requetes[0]);
+	close(reponses[1]);
+	if (pid < 0) {
+		close(requetes[1]);
+		close(reponses[0]);
+		return -1;
+	}
+
+	pthread_mutex_lock(&verrou_analyseur);
+	verificateur = pid;
+	vers_verificateur = requetes[1];
+	depuis_verificateur = reponses[0];
+	pthread_mutex_unlock(&verrou_analyseur);
+	return 0;
+}
+
+
+void arreter_verification(void)
+{
+	pthread_mutex_lock(&verrou_analyseur);
+
+	if (verificateur >= 0) {
+		close(vers_verificateur);
+		close(depuis_verificateur);
+		while (waitpid(verificateur, NULL, 0) < 0 && errno == EINTR)
+			continue;
+		verificateur = -1;
+		vers_verificateur = depuis_verificateur = -1;
+	}
+
+	pthread_mutex_unlock(&verrou_analyseur);
+}
+
+
+/* Verification par le verificateur. Retourne 1 si l'expression est
+ * correcte, 0 sinon (ou s'il ne repond pas). */
+static int verifier_a_distance(const char *chemin)
+{
+	size_t n = strlen(chemin);
+	unsigned char correcte = 0;
+
+	if (n >= CHEMIN_MAX
+	    || ecrire_tout(vers_verificateur, &n, sizeof (n)) != 0
+	    || ecrire_tout(vers_verificateur, chemin, n) != 0
+	    || lire_tout(depuis_verificateur, &correcte, 1) != 0)
+		return 0;
+
+	return correcte == 1;
+}
+
+
+struct noeud_ast *analyser_sans_risque(const char *chemin)
+{
+	struct noeud_ast *ast = NULL;
+
+	pthread_mutex_lock(&verrou_analyseur);
+	int correcte = (verificateur >= 0) ? verifier_a_distance(chemin) : verifier(chemin);
+	if (correcte)
+		analyser((unsigned char *) chemin, &ast);
+	pthread_mutex_unlock(&verrou_analyseur);
+
+	return ast;
+}
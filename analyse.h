@@ -0,0 +1,24 @@
+#ifndef ANALYSE_H
+#define ANALYSE_H
+
+#include "ast.h"
+
+/* Analyse l'expression du fichier chemin (cf. analyser dans parser.h) sans
+ * risquer de terminer le processus : l'analyseur appelle exit sur une
+ * erreur de syntaxe, l'expression est donc d'abord analysee dans un
+ * processus fils, cree par le verificateur s'il est lance. Les appels
+ * concurrents sont serialises (l'analyseur n'est pas reentrant).
+ * Retourne l'arbre de l'expression, ou NULL si elle est incorrecte. */
+extern struct noeud_ast *analyser_sans_risque(const char *chemin);
+
+/* Lance le verificateur : un processus auxiliaire, a un seul fil, qui cree
+ * les processus fils de analyser_sans_risque. Un processus a plusieurs fils
+ * ne doit pas les creer lui-meme (le fils n'y peut appeler sans risque
+ * malloc ou stdio) : a appeler avant la creation des fils.
+ * Retourne 0, ou -1 si le processus ne peut etre lance. */
+extern int demarrer_verification(void);
+
+/* Arrete le verificateur (sans effet s'il n'est pas lance). */
+extern void arreter_verification(void);
+
+#endif /* ANALYSE_H */
@@ -1,4 +1,10 @@
+#include <string.h>
 #include "ast.h"
+#include "stats.h"
+#include "cache.h"
+#include "depot.h"
+#include "rle.h"
+#include "quadtree.h"
 
 /* constantes pour l'affichage des noms */
 static const char *noms_primitifs[NB_NAT_PRIMITIFS] = {
@@ -12,6 +18,12 @@ static const char *noms_operations[NB_OPERATIONS] = {
 	"SUPER"
 };
 
+static const char *noms_representations[NB_REPRESENTATIONS] = {
+	"grille",
+	"plages",
+	"quadtree"
+};
+
 
 
 /*---------------------------------------------------------------------------*/
@@ -50,6 +62,24 @@ typedef struct patchwork *(*creer_patchwork_binaire_fct)
                                                 (const struct patchwork *,
                                                  const struct patchwork *);
 
+/* Meme chose pour la representation par plages (module rle.o) */
+typedef struct patchwork_rle *(*creer_rle_valeur_fct)
+                                                (const enum nature_primitif);
+typedef struct patchwork_rle *(*creer_rle_unaire_fct)
+                                                (const struct patchwork_rle *);
+typedef struct patchwork_rle *(*creer_rle_binaire_fct)
+                                                (const struct patchwork_rle *,
+                                                 const struct patchwork_rle *);
+
+/* Et pour les arbres quaternaires (module quadtree.o) */
+typedef struct patchwork_qt *(*creer_qt_valeur_fct)
+                                                (const enum nature_primitif);
+typedef struct patchwork_qt *(*creer_qt_unaire_fct)
+                                                (const struct patchwork_qt *);
+typedef struct patchwork_qt *(*creer_qt_binaire_fct)
+                                                (const struct patchwork_qt *,
+                                                 const struct patchwork_qt *);
+
 
 
 /*---------------------------------------------------------------------------*/
@@ -72,12 +102,16 @@ enum arite_operation {
 struct operation_unaire {
 	struct noeud_ast *operande;
 	creer_patchwork_unaire_fct creer_patchwork;
+	creer_rle_unaire_fct creer_rle;
+	creer_qt_unaire_fct creer_qt;
 };
 
 struct operation_binaire {
 	struct noeud_ast *operande_gauche;
 	struct noeud_ast *operande_droit;
 	creer_patchwork_binaire_fct creer_patchwork;
+	creer_rle_binaire_fct creer_rle;
+	creer_qt_binaire_fct creer_qt;
 };
 
 struct operation {
@@ -92,12 +126,21 @@ struct operation {
 struct valeur {
 	enum nature_primitif nature;
 	creer_patchwork_valeur_fct creer_patchwork;
+	creer_rle_valeur_fct creer_rle;
+	creer_qt_valeur_fct creer_qt;
 };
 
 
 struct noeud_ast_data {
 	const char *nom;
 
+	// empreinte structurelle du sous-arbre, calculee a la creation
+	uint64_t empreinte;
+	// dimensions du patchwork resultat (0 x 0 si elles sont incompatibles)
+	uint32_t hauteur, largeur;
+	// primitifs des resultats de tous les noeuds du sous-arbre (sature)
+	uint64_t cellules_totales;
+
 	// nature du noeud: VALEUR ou OPERATION
 	enum nature_noeud nature;
 	// selon la nature, les donnees representant le noeud
@@ -110,6 +153,12 @@ struct noeud_ast_data {
 /*----------- Fonctions de vérification */
 static void erreur(const char *msg);
 
+/*----------- Empreintes */
+static uint64_t melanger(uint64_t h, uint64_t v);
+
+/*----------- Bornes */
+static uint64_t somme_saturee(uint64_t a, uint64_t b);
+
 /*---------------------------------------------------------------------------*/
 /*     AFFICHAGE                                                             */
 /*---------------------------------------------------------------------------*/
@@ -218,6 +267,212 @@ static struct patchwork *evaluer_binaire(struct noeud_ast *ast)
 
 
 
+/* Parcours postfixe commun aux evaluations dans une representation
+ * quelconque : le resultat d'un noeud est d'abord cherche (si chercher
+ * n'est pas NULL et le trouve), sinon calcule par les fonctions de creation
+ * branchees sur le noeud a partir des resultats de ses fils, puis confie a
+ * garder (si non NULL). Les resultats des fils sont liberes par liberer,
+ * sauf s'il est NULL (ils appartiennent alors a un cache). */
+struct parcours {
+	int (*chercher)(struct noeud_ast *ast, void *contexte, void **res);
+	void *(*valeur)(struct noeud_ast *ast);
+	void *(*unaire)(struct noeud_ast *ast, void *base);
+	void *(*binaire)(struct noeud_ast *ast, void *base_g, void *base_d);
+	void *(*garder)(struct noeud_ast *ast, void *contexte, void *res);
+	void (*liberer)(void *p);
+	void *contexte;
+};
+
+static void *evaluer_postfixe(struct noeud_ast *ast, const struct parcours *pc)
+{
+	if (ast == NULL || ast->data == NULL)
+		return NULL;
+
+	void *res = NULL;
+	if (pc->chercher != NULL && pc->chercher(ast, pc->contexte, &res))
+		return res;
+
+	if (ast->data->nature == VALEUR) {
+		res = pc->valeur(ast);
+	} else if (ast->data->u.oper.arite == UNAIRE) {
+		void *base = evaluer_postfixe(ast->data->u.oper.u.oper_un.operande, pc);
+		res = pc->unaire(ast, base);
+		if (pc->liberer != NULL)
+			pc->liberer(base);
+	} else {
+		struct operation_binaire *op = &ast->data->u.oper.u.oper_bin;
+		void *base_g = evaluer_postfixe(op->operande_gauche, pc);
+		void *base_d = evaluer_postfixe(op->operande_droit, pc);
+		res = pc->binaire(ast, base_g, base_d);
+		if (pc->liberer != NULL) {
+			pc->liberer(base_g);
+			pc->liberer(base_d);
+		}
+	}
+
+	if (res != NULL && pc->garder != NULL)
+		res = pc->garder(ast, pc->contexte, res);
+
+	return res;
+}
+
+
+/* Fonctions de creation et de liberation d'une representation, pour
+ * evaluer_postfixe : champ designe les fonctions branchees sur les noeuds
+ * (creer_patchwork, creer_rle, creer_qt). */
+#define PARCOURS_REPRESENTATION(nom, champ, liberation)                              \
+	static void *valeur_##nom(struct noeud_ast *ast)                             \
+	{                                                                            \
+		return ast->data->u.val.champ(ast->data->u.val.nature);              \
+	}                                                                            \
+	static void *unaire_##nom(struct noeud_ast *ast, void *base)                 \
+	{                                                                            \
+		return ast->data->u.oper.u.oper_un.champ(base);                      \
+	}                                                                            \
+	static void *binaire_##nom(struct noeud_ast *ast, void *base_g, void *base_d) \
+	{                                                                            \
+		return ast->data->u.oper.u.oper_bin.champ(base_g, base_d);           \
+	}                                                                            \
+	static void liberer_##nom(void *p)                                           \
+	{                                                                            \
+		liberation(p);                                                       \
+	}
+
+PARCOURS_REPRESENTATION(grille, creer_patchwork, liberer_patchwork)
+PARCOURS_REPRESENTATION(rle, creer_rle, liberer_patchwork_rle)
+PARCOURS_REPRESENTATION(qt, creer_qt, liberer_patchwork_qt)
+
+
+/* Evaluation avec cache : un sous-arbre deja evalue (meme empreinte) n'est
+ * pas reevalue. Les patchworks intermediaires restent dans le cache. */
+static int chercher_cache(struct noeud_ast *ast, void *cache, void **res)
+{
+	*res = cache_chercher(cache, ast->data->empreinte);
+	return *res != NULL;
+}
+
+static void *garder_cache(struct noeud_ast *ast, void *cache, void *res)
+{
+	// Un patchwork que le cache ne peut garder n'aurait pas de proprietaire :
+	// l'evaluation echoue
+	if (cache_ajouter(cache, ast->data->empreinte, res) != 0) {
+		liberer_patchwork(res);
+		return NULL;
+	}
+	return res;
+}
+
+struct patchwork *evaluer_cache(struct noeud_ast *ast, struct cache *cache)
+{
+	const struct parcours pc = { chercher_cache, valeur_grille, unaire_grille, binaire_grille,
+	                             garder_cache, NULL, cache };
+	return evaluer_postfixe(ast, &pc);
+}
+
+
+uint64_t empreinte_expression(const struct noeud_ast *ast)
+{
+	return (ast != NULL && ast->data != NULL) ? ast->data->empreinte : 0;
+}
+
+
+void dimensions_expression(const struct noeud_ast *ast, uint32_t *hauteur, uint32_t *largeur)
+{
+	*hauteur = (ast != NULL && ast->data != NULL) ? ast->data->hauteur : 0;
+	*largeur = (ast != NULL && ast->data != NULL) ? ast->data->largeur : 0;
+}
+
+
+uint64_t cellules_expression(const struct noeud_ast *ast)
+{
+	if (ast == NULL || ast->data == NULL)
+		return 0;
+
+	return (uint64_t) ast->data->hauteur * ast->data->largeur;
+}
+
+
+uint64_t cellules_totales_expression(const struct noeud_ast *ast)
+{
+	return (ast != NULL && ast->data != NULL) ? ast->data->cellules_totales : 0;
+}
+
+
+/* Evaluation avec le depot sur disque : un sous-arbre d'au moins seuil
+ * primitifs est d'abord cherche dans le depot, et y est enregistre une
+ * fois evalue. Les sous-arbres plus petits sont evalues normalement. */
+struct evaluation_depot {
+	struct depot *depot;
+	uint64_t seuil;
+};
+
+static int grand_pour_depot(const struct noeud_ast *ast, uint64_t seuil)
+{
+	// Au-dela de UINT16_MAX, l'evaluation echoue : rien a chercher
+	return cellules_expression(ast) >= seuil
+		&& ast->data->hauteur <= UINT16_MAX && ast->data->largeur <= UINT16_MAX;
+}
+
+static int chercher_depot(struct noeud_ast *ast, void *contexte, void **res)
+{
+	struct evaluation_depot *e = contexte;
+	if (!grand_pour_depot(ast, e->seuil)) {
+		*res = ast->evaluer(ast);
+		return 1;
+	}
+
+	*res = depot_lire(e->depot, ast->data->empreinte,
+	                  (uint16_t) ast->data->hauteur, (uint16_t) ast->data->largeur);
+	return *res != NULL;
+}
+
+static void *garder_depot(struct noeud_ast *ast, void *contexte, void *res)
+{
+	struct evaluation_depot *e = contexte;
+	depot_ecrire(e->depot, ast->data->empreinte, res);
+	return res;
+}
+
+struct patchwork *evaluer_depot(struct noeud_ast *ast, struct depot *depot, uint64_t seuil)
+{
+	struct evaluation_depot e = { depot, seuil };
+	const struct parcours pc = { chercher_depot, valeur_grille, unaire_grille, binaire_grille,
+	                             garder_depot, liberer_grille, &e };
+	return evaluer_postfixe(ast, &pc);
+}
+
+
+/* Evaluation dans la representation par plages : meme parcours postfixe
+ * que les fonctions d'evaluation des noeuds, avec les fonctions de creation
+ * par plages branchees a la creation des noeuds. */
+struct patchwork_rle *evaluer_rle(struct noeud_ast *ast)
+{
+	const struct parcours pc = { NULL, valeur_rle, unaire_rle, binaire_rle,
+	                             NULL, liberer_rle, NULL };
+	return evaluer_postfixe(ast, &pc);
+}
+
+
+/* Evaluation par arbres quaternaires, sur le meme modele. */
+struct patchwork_qt *evaluer_qt(struct noeud_ast *ast)
+{
+	const struct parcours pc = { NULL, valeur_qt, unaire_qt, binaire_qt,
+	                             NULL, liberer_qt, NULL };
+	return evaluer_postfixe(ast, &pc);
+}
+
+
+enum representation representation_depuis_nom(const char *nom)
+{
+	for (int k = 0; k < NB_REPRESENTATIONS; ++k) {
+		if (strcmp(nom, noms_representations[k]) == 0)
+			return (enum representation) k;
+	}
+
+	return NB_REPRESENTATIONS;
+}
+
+
 /*---------------------------------------------------------------------------*/
 /*     CREATION DES NOEUDS                                                   */
 /*---------------------------------------------------------------------------*/
@@ -232,6 +487,9 @@ struct noeud_ast *creer_valeur(const enum nature_primitif nat_prim)
 
 	struct noeud_ast *noeud = malloc(sizeof(struct noeud_ast));
 	struct noeud_ast_data *data = malloc(sizeof(struct noeud_ast_data));
+	stats.noeuds++;
+	stats_allocation(sizeof(struct noeud_ast));
+	stats_allocation(sizeof(struct noeud_ast_data));
 
 	// Initialisation du contenu du "noeud_ast" et branchements
 	noeud->data = data;
@@ -242,7 +500,12 @@ struct noeud_ast *creer_valeur(const enum nature_primitif nat_prim)
 	data->nom = noms_primitifs[nat_prim];
 	data->nature = VALEUR;
 	data->u.val.nature = nat_prim;
+	data->empreinte = melanger(VALEUR + 1, nat_prim);
+	data->hauteur = data->largeur = 1;
+	data->cellules_totales = 1;
 	data->u.val.creer_patchwork = &creer_primitif;
+	data->u.val.creer_rle = &creer_primitif_rle;
+	data->u.val.creer_qt = &creer_primitif_qt;
 
 	return noeud;
 }
@@ -256,6 +519,9 @@ struct noeud_ast *creer_unaire(const enum nature_operation nat_oper,
 
 	struct noeud_ast *noeud = malloc(sizeof(struct noeud_ast));
 	struct noeud_ast_data *data = malloc(sizeof(struct noeud_ast_data));
+	stats.noeuds++;
+	stats_allocation(sizeof(struct noeud_ast));
+	stats_allocation(sizeof(struct noeud_ast_data));
 
 	// Initialisation du contenu du "noeud_ast" et branchements
 	noeud->data = data;
@@ -267,10 +533,17 @@ struct noeud_ast *creer_unaire(const enum nature_operation nat_oper,
 	data->nature = OPERATION;
 	data->u.oper.arite = UNAIRE;
 	data->u.oper.u.oper_un.operande = opde;
+	data->empreinte = melanger(melanger(OPERATION + 1, nat_oper), empreinte_expression(opde));
+	data->hauteur = (opde != NULL) ? opde->data->largeur : 0;
+	data->largeur = (opde != NULL) ? opde->data->hauteur : 0;
+	data->cellules_totales = somme_saturee(cellules_expression(noeud),
+	                                       cellules_totales_expression(opde));
 
 	// INFO. Fonctionne tant que la seule opération unaire est "ROTATION".
 	// Si cela change, il faudra différencier les cas (cf. binaire).
 	data->u.oper.u.oper_un.creer_patchwork = &creer_rotation;
+	data->u.oper.u.oper_un.creer_rle = &creer_rotation_rle;
+	data->u.oper.u.oper_un.creer_qt = &creer_rotation_qt;
 
 	return noeud;
 }
@@ -285,6 +558,9 @@ struct noeud_ast *creer_binaire(const enum nature_operation nat_oper,
 
 	struct noeud_ast *noeud = malloc(sizeof(struct noeud_ast));
 	struct noeud_ast_data *data = malloc(sizeof(struct noeud_ast_data));
+	stats.noeuds++;
+	stats_allocation(sizeof(struct noeud_ast));
+	stats_allocation(sizeof(struct noeud_ast_data));
 
 	// Initialisation du contenu du "noeud_ast" et branchements
 	noeud->data = data;
@@ -297,18 +573,41 @@ struct noeud_ast *creer_binaire(const enum nature_operation nat_oper,
 	data->u.oper.arite = BINAIRE;
 	data->u.oper.u.oper_bin.operande_gauche = opde_g;
 	data->u.oper.u.oper_bin.operande_droit = opde_d;
+	data->empreinte = melanger(melanger(melanger(OPERATION + 1, nat_oper),
+					    empreinte_expression(opde_g)),
+				   empreinte_expression(opde_d));
 
 	switch (nat_oper) {
 		case JUXTAPOSITION:
 			data->u.oper.u.oper_bin.creer_patchwork = &creer_juxtaposition;
+			data->u.oper.u.oper_bin.creer_rle = &creer_juxtaposition_rle;
+			data->u.oper.u.oper_bin.creer_qt = &creer_juxtaposition_qt;
 			break;
 		case SUPERPOSITION:
 			data->u.oper.u.oper_bin.creer_patchwork = &creer_superposition;
+			data->u.oper.u.oper_bin.creer_rle = &creer_superposition_rle;
+			data->u.oper.u.oper_bin.creer_qt = &creer_superposition_qt;
 			break;
 		default:
 			exit(EXIT_FAILURE);
 	}
 
+	// Dimensions : memes regles que creer_juxtaposition / creer_superposition
+	data->hauteur = data->largeur = 0;
+	if (opde_g != NULL && opde_d != NULL) {
+		const struct noeud_ast_data *g = opde_g->data, *d = opde_d->data;
+		if (nat_oper == JUXTAPOSITION && g->hauteur == d->hauteur) {
+			data->hauteur = g->hauteur;
+			data->largeur = g->largeur + d->largeur;
+		} else if (nat_oper == SUPERPOSITION && g->largeur == d->largeur) {
+			data->hauteur = g->hauteur + d->hauteur;
+			data->largeur = g->largeur;
+		}
+	}
+	data->cellules_totales = somme_saturee(somme_saturee(cellules_expression(noeud),
+	                                                     cellules_totales_expression(opde_g)),
+	                                       cellules_totales_expression(opde_d));
+
 	return noeud;
 }
 
@@ -343,6 +642,25 @@ void liberer_expression(struct noeud_ast *res)
 	}
 }
 
+/* Combinaison de deux valeurs 64 bits, suivie du brassage final de
+ * splitmix64 pour repartir les empreintes voisines. */
+static uint64_t melanger(uint64_t h, uint64_t v)
+{
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+/* Somme bornee a UINT64_MAX. */
+static uint64_t somme_saturee(uint64_t a, uint64_t b)
+{
+	return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
 void erreur(const char *msg) {
 	printf("%s", msg);
 	exit(EXIT_FAILURE);
@@ -2,8 +2,14 @@
 #define AST_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "patchwork.h"
 
+struct cache;
+struct depot;
+struct patchwork_rle;
+struct patchwork_qt;
+
 /* Natures des operations sur les motifs */
 enum nature_operation {
 	ROTATION,
@@ -12,6 +18,14 @@ enum nature_operation {
 	NB_OPERATIONS	/* sentinelle */
 };
 
+/* Representations des patchworks pour l'evaluation */
+enum representation {
+	GRILLE,		/* struct patchwork : un element par primitif */
+	PLAGES,		/* struct patchwork_rle : plages de chaque ligne */
+	QUADTREE,	/* struct patchwork_qt : arbre quaternaire partage */
+	NB_REPRESENTATIONS	/* sentinelle */
+};
+
 
 /* Structure de noeud de l'arbre (AST: Abstrat Syntax Tree), representant une
  * expression de type operation unaire ou binaire (noeud interne) ou une
@@ -69,4 +83,55 @@ extern struct noeud_ast *creer_binaire(const enum nature_operation nat_oper,
 				       struct noeud_ast *opde_g,
 				       struct noeud_ast *opde_d);
 
+/* Retourne l'empreinte structurelle (64 bits) de l'arbre ast, calculee a
+ * la creation des noeuds : deux arbres de meme structure (memes operations,
+ * memes primitifs, dans le meme ordre) ont la meme empreinte. */
+extern uint64_t empreinte_expression(const struct noeud_ast *ast);
+
+/* Evalue l'arbre ast en consultant le cache (cf. cache.h) : les sous-arbres
+ * dont l'empreinte y figure ne sont pas reevalues, et chaque patchwork
+ * calcule y est ajoute. Le patchwork retourne appartient au cache ; NULL
+ * si l'expression est incorrecte ou si le cache ne peut garder un resultat.
+ * Plusieurs evaluations peuvent partager un cache simultanement, chacune
+ * entre cache_commencer et cache_terminer. */
+extern struct patchwork *evaluer_cache(struct noeud_ast *ast, struct cache *cache);
+
+/* Dimensions du patchwork resultat de l'arbre ast, connues sans l'evaluer
+ * (0 x 0 si elles sont incompatibles). Elles peuvent depasser les limites
+ * d'un struct patchwork (uint16_t). */
+extern void dimensions_expression(const struct noeud_ast *ast,
+                                  uint32_t *hauteur, uint32_t *largeur);
+
+/* Retourne le nombre de primitifs du patchwork resultat de l'arbre ast,
+ * connu sans l'evaluer (0 si les dimensions sont incompatibles). */
+extern uint64_t cellules_expression(const struct noeud_ast *ast);
+
+/* Retourne la somme des primitifs des patchworks de tous les noeuds de
+ * l'arbre ast (resultat compris), connue sans l'evaluer : une borne de la
+ * memoire d'une evaluation qui garde les resultats intermediaires, comme
+ * evaluer_cache. Bornee a UINT64_MAX. */
+extern uint64_t cellules_totales_expression(const struct noeud_ast *ast);
+
+/* Evalue l'arbre ast en consultant le depot sur disque (cf. depot.h) pour
+ * les sous-arbres d'au moins seuil primitifs : un sous-arbre present dans
+ * le depot y est relu au lieu d'etre evalue, un sous-arbre absent y est
+ * enregistre apres evaluation. Le patchwork retourne est a liberer. */
+extern struct patchwork *evaluer_depot(struct noeud_ast *ast, struct depot *depot,
+                                       uint64_t seuil);
+
+/* Evalue l'arbre ast dans la representation par plages (cf. rle.h) :
+ * memes operations, sur les plages de chaque ligne plutot que sur les
+ * primitifs. Le patchwork retourne est a liberer (NULL si les dimensions
+ * sont incompatibles). */
+extern struct patchwork_rle *evaluer_rle(struct noeud_ast *ast);
+
+/* Evalue l'arbre ast dans la representation par arbres quaternaires (cf.
+ * quadtree.h). Le patchwork retourne est a liberer ; ses noeuds restent
+ * dans la foret du module jusqu'a vider_quadtrees. */
+extern struct patchwork_qt *evaluer_qt(struct noeud_ast *ast);
+
+/* Retourne la representation de nom nom ("grille", "plages", "quadtree"),
+ * ou NB_REPRESENTATIONS. */
+extern enum representation representation_depuis_nom(const char *nom);
+
 #endif /* AST_H */
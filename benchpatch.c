@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200809L	/* clock_gettime */
+#include <stdlib.h>
+#include <stdio.h>
+#include <argp.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "ast.h"
+#include "parser.h"
+#include "image.h"
+#include "tuiles.h"
+
+/* Mesure des trois phases de la construction d'un patchwork : analyse de
+ * l'expression (analyser), evaluation de l'AST (evaluer) et rendu de
+ * l'image (creer_images_tuiles). Une ligne de resultats par expression ;
+ * le pic de memoire residente est celui du processus, d'ou une execution
+ * par expression (cf. la cible bench du Makefile). */
+
+/*---------------------------------------------------------------------------*/
+// Lecture de la ligne de commande
+
+const char *argp_program_version = "Patchwork / v1.0";
+const char *argp_program_bug_address = "<aurelien.pepin@ensimag.fr>";
+static char doc[] = "benchpatch -- Mesure des phases de construction d'un patchwork";
+static char args_doc[] = "FICHIER";
+
+static struct argp_option options[] = {
+	{ "size", 's', "4", 0, "Taille (de côté) d'un motif", 0 },
+	{ "output", 'o', "/dev/null", 0, "Chemin de l'image produite", 0 },
+	{ "format", 'F', "ppm", 0, "Format de sortie : ppm, qoi, png", 0 },
+	{ "blocs", 'b', "0", 0, "Rendu par blocs de K x K primitifs (0 : par lignes)", 0 },
+	{ "representation", 'r', "grille", 0, "Representation des patchworks : grille, plages, quadtree", 0 },
+	{ "entete", 'e', 0, 0, "Afficher seulement l'en-tête des colonnes", 0 },
+	{ 0, 0, 0, 0, 0, 0 }
+};
+
+struct arguments {
+	char *input;
+	char *output;
+	uintmax_t size;
+	enum format_sortie format;
+	uintmax_t blocs;
+	enum representation representation;
+	int entete;
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state) {
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+		case 's':
+			arguments->size = strtoumax(arg, NULL, 10);
+			if (arguments->size == 0 || arguments->size > 4096)
+				argp_usage (state);
+			break;
+		case 'o':
+			arguments->output = arg;
+			break;
+		case 'F':
+			arguments->format = format_depuis_nom(arg);
+			if (arguments->format == NB_FORMATS)
+				argp_usage (state);
+			break;
+		case 'b':
+			arguments->blocs = strtoumax(arg, NULL, 10);
+			if (arguments->blocs == 1 || arguments->blocs > 16)
+				argp_usage (state);
+			break;
+		case 'r':
+			arguments->representation = representation_depuis_nom(arg);
+			if (arguments->representation == NB_REPRESENTATIONS)
+				argp_usage (state);
+			break;
+		case 'e':
+			arguments->entete = 1;
+			break;
+		case ARGP_KEY_ARG:
+			if (state->arg_num > 0)
+				argp_usage (state);
+			arguments->input = arg;
+			break;
+		case ARGP_KEY_END:
+			if (arguments->input == NULL && !arguments->entete)
+				argp_usage (state);
+			break;
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp arg_p = { options, parse_opt, args_doc, doc, 0, 0, 0 };
+
+/*---------------------------------------------------------------------------*/
+
+static double maintenant(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Debit en millions d'unites par seconde (0 si duree nulle). */
+static double debit(double quantite, double duree)
+{
+	return (duree > 0) ? quantite / duree / 1e6 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct arguments arguments;
+	arguments.input = NULL;
+	arguments.output = "/dev/null";
+	arguments.size = 4;
+	arguments.format = FORMAT_PPM;
+	arguments.blocs = 0;
+	arguments.representation = GRILLE;
+	arguments.entete = 0;
+
+	argp_parse (&arg_p, argc, argv, 0, 0, &arguments);
+
+	if (arguments.entete) {
+		printf("%-28s %11s %10s %10s %10s %10s %10s %9s %9s\n",
+			   "expression", "cellules", "analyse", "eval", "rendu",
+			   "Mcell/s", "Mcell/s", "Mo/s", "RSS max");
+		printf("%-28s %11s %10s %10s %10s %10s %10s %9s %9s\n",
+			   "", "", "(ms)", "(ms)", "(ms)", "(eval)", "(rendu)", "(rendu)", "(Mio)");
+		return EXIT_SUCCESS;
+	}
+
+	unsigned int cote = (unsigned int) arguments.size;
+	char chaine_carre[256], chaine_triangle[256];
+	chemin_motif(chaine_carre, sizeof (chaine_carre), NULL, "carre", cote);
+	chemin_motif(chaine_triangle, sizeof (chaine_triangle), NULL, "triangle", cote);
+
+	struct tuiles *tuiles = charger_tuiles(chaine_carre, chaine_triangle, cote, BILINEAIRE);
+	if (tuiles == NULL)
+		return EXIT_FAILURE;
+
+	// Phase 1 : analyse
+	struct noeud_ast *noeud_analyseur;
+	double t0 = maintenant();
+	analyser((unsigned char *) arguments.input, &noeud_analyseur);
+
+	// Phase 2 : evaluation
+	double t1 = maintenant();
+	struct patchwork *patch = NULL;
+	struct patchwork_rle *rle = NULL;
+	struct patchwork_qt *qt = NULL;
+	if (arguments.representation == PLAGES)
+		rle = evaluer_rle(noeud_analyseur);
+	else if (arguments.representation == QUADTREE)
+		qt = evaluer_qt(noeud_analyseur);
+	else
+		patch = noeud_analyseur->evaluer(noeud_analyseur);
+	double t2 = maintenant();
+
+	if (patch == NULL && rle == NULL && qt == NULL) {
+		fprintf(stderr, "ERREUR. L'expression %s est incorrecte.\n", arguments.input);
+		liberer_expression(noeud_analyseur);
+		liberer_tuiles(tuiles);
+		return EXIT_FAILURE;
+	}
+
+	// Phase 3 : rendu, jusqu'a la fermeture (et donc l'ecriture) du fichier
+	struct ecrivain *ecrivain = creer_ecrivain_asynchrone(arguments.output, 4, 1 << 20, 0);
+	if (ecrivain == NULL) {
+		liberer_patchwork(patch);
+		liberer_patchwork_rle(rle);
+		liberer_patchwork_qt(qt);
+		liberer_expression(noeud_analyseur);
+		liberer_tuiles(tuiles);
+		return EXIT_FAILURE;
+	}
+
+	const char *nom = arguments.output;
+	const struct tuiles *jeu = tuiles;
+	double t3 = maintenant();
+	int rendu;
+	if (rle != NULL)
+		rendu = creer_images_tuiles_rle(rle, &jeu, &ecrivain, &nom, 1, arguments.format);
+	else if (qt != NULL)
+		rendu = creer_images_tuiles_qt(qt, &jeu, &ecrivain, &nom, 1, arguments.format);
+	else
+		rendu = creer_images_tuiles(patch, &jeu, &ecrivain, &nom, 1, arguments.format,
+									(unsigned int) arguments.blocs);
+	double t4 = maintenant();
+	fflush(stdout);
+
+	// Volume produit : taille du fichier, ou de l'image brute sinon (/dev/null)
+	struct stat infos;
+	double cellules = (rle != NULL) ? (double) rle->hauteur * rle->largeur
+					: (qt != NULL) ? (double) qt->hauteur * qt->largeur
+					: (double) patch->hauteur * patch->largeur;
+	double octets = 3.0 * cellules * cote * cote;
+	if (stat(arguments.output, &infos) == 0 && S_ISREG(infos.st_mode))
+		octets = (double) infos.st_size;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	const char *court = strrchr(arguments.input, '/');
+	printf("%-28s %11.0f %10.2f %10.2f %10.2f %10.2f %10.2f %9.1f %9.1f\n",
+		   court ? court + 1 : arguments.input, cellules,
+		   (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t4 - t3) * 1e3,
+		   debit(cellules, t2 - t1), debit(cellules, t4 - t3),
+		   debit(octets, t4 - t3), usage.ru_maxrss / 1024.0);
+
+	liberer_patchwork(patch);
+	liberer_patchwork_rle(rle);
+	liberer_patchwork_qt(qt);
+	vider_quadtrees();
+	liberer_expression(noeud_analyseur);
+	liberer_tuiles(tuiles);
+
+	return rendu == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "cache.h"
+
+/* Nombre initial d'alveoles de la table (puissance de 2) */
+#define CACHE_TAILLE_INITIALE 256
+
+struct entree {
+	uint64_t empreinte;
+	struct patchwork *patchwork;
+	unsigned long generation;	/* derniere generation utilisatrice */
+	struct entree *suivante;	/* chainage de l'alveole */
+};
+
+/* Evaluation en cours (cf. cache_commencer) */
+struct evaluation {
+	unsigned long generation;
+	struct evaluation *suivante;
+};
+
+struct cache {
+	pthread_mutex_t verrou;	/* toutes les fonctions le prennent */
+	struct entree **alveoles;
+	size_t nb_alveoles;
+	size_t nb_entrees;
+	size_t octets;		/* memoire des patchworks du cache */
+	unsigned long generation;
+	struct evaluation *en_cours;
+	unsigned long succes, echecs;
+};
+
+
+struct cache *creer_cache(void)
+{
+	struct cache *c = calloc(1, sizeof (struct cache));
+	if (c == NULL)
+		return NULL;
+
+	c->nb_alveoles = CACHE_TAILLE_INITIALE;
+	c->alveoles = calloc(c->nb_alveoles, sizeof (struct entree *));
+	if (c->alveoles == NULL) {
+		free(c);
+		return NULL;
+	}
+
+	pthread_mutex_init(&c->verrou, NULL);
+	return c;
+}
+
+
+/* Memoire occupee par le patchwork p (cf. taille_patchwork). */
+static size_t octets_patchwork(const struct patchwork *p)
+{
+	return sizeof (struct patchwork) + p->hauteur * sizeof (struct primitif *)
+		+ (size_t) p->hauteur * p->largeur * sizeof (struct primitif);
+}
+
+
+static size_t alveole(const struct cache *c, uint64_t empreinte)
+{
+	return (size_t) (empreinte ^ (empreinte >> 32)) & (c->nb_alveoles - 1);
+}
+
+
+/* Doublement de la table lorsque le taux de remplissage depasse 1. */
+static void agrandir(struct cache *c)
+{
+	size_t nb = 2 * c->nb_alveoles;
+	struct entree **alveoles = calloc(nb, sizeof (struct entree *));
+	if (alveoles == NULL)
+		return;	// La table reste valide, seulement plus chargee
+
+	struct entree **anciennes = c->alveoles;
+	size_t nb_anciennes = c->nb_alveoles;
+	c->alveoles = alveoles;
+	c->nb_alveoles = nb;
+
+	for (size_t k = 0; k < nb_anciennes; ++k) {
+		struct entree *e = anciennes[k];
+		while (e != NULL) {
+			struct entree *suivante = e->suivante;
+			size_t a = alveole(c, e->empreinte);
+			e->suivante = alveoles[a];
+			alveoles[a] = e;
+			e = suivante;
+		}
+	}
+
+	free(anciennes);
+}
+
+
+struct patchwork *cache_chercher(struct cache *c, uint64_t empreinte)
+{
+	struct patchwork *res = NULL;
+	pthread_mutex_lock(&c->verrou);
+
+	for (struct entree *e = c->alveoles[alveole(c, empreinte)]; e != NULL; e = e->suivante) {
+		if (e->empreinte == empreinte) {
+			e->generation = c->generation;
+			res = e->patchwork;
+			break;
+		}
+	}
+
+	if (res != NULL)
+		c->succes++;
+	else
+		c->echecs++;
+
+	pthread_mutex_unlock(&c->verrou);
+	return res;
+}
+
+
+int cache_ajouter(struct cache *c, uint64_t empreinte, struct patchwork *p)
+{
+	struct entree *e = malloc(sizeof (struct entree));
+	if (e == NULL)
+		return -1;
+
+	pthread_mutex_lock(&c->verrou);
+
+	if (c->nb_entrees >= c->nb_alveoles)
+		agrandir(c);
+
+	size_t a = alveole(c, empreinte);
+	e->empreinte = empreinte;
+	e->patchwork = p;
+	e->generation = c->generation;
+	e->suivante = c->alveoles[a];
+	c->alveoles[a] = e;
+	c->nb_entrees++;
+	c->octets += octets_patchwork(p);
+
+	pthread_mutex_unlock(&c->verrou);
+	return 0;
+}
+
+
+int cache_garder(struct cache *c, uint64_t empreinte)
+{
+	int trouvee = 0;
+	pthread_mutex_lock(&c->verrou);
+
+	for (struct entree *e = c->alveoles[alveole(c, empreinte)]; e != NULL && !trouvee;
+	     e = e->suivante) {
+		if (e->empreinte == empreinte) {
+			e->generation = c->generation;
+			trouvee = 1;
+		}
+	}
+
+	pthread_mutex_unlock(&c->verrou);
+	return trouvee;
+}
+
+
+void cache_nouvelle_generation(struct cache *c)
+{
+	pthread_mutex_lock(&c->verrou);
+	c->generation++;
+	pthread_mutex_unlock(&c->verrou);
+}
+
+
+unsigned long cache_commencer(struct cache *c)
+{
+	struct evaluation *ev = malloc(sizeof (struct evaluation));
+	if (ev == NULL)
+		return 0;
+
+	pthread_mutex_lock(&c->verrou);
+	ev->generation = ++c->generation;
+	ev->suivante = c->en_cours;
+	c->en_cours = ev;
+	pthread_mutex_unlock(&c->verrou);
+
+	return ev->generation;
+}
+
+
+void cache_terminer(struct cache *c, unsigned long generation)
+{
+	pthread_mutex_lock(&c->verrou);
+
+	for (struct evaluation **ev = &c->en_cours; *ev != NULL; ev = &(*ev)->suivante) {
+		if ((*ev)->generation == generation) {
+			struct evaluation *finie = *ev;
+			*ev = finie->suivante;
+			free(finie);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&c->verrou);
+}
+
+
+/* Liberation des entrees de generation anterieure a la courante et a
+ * celles des evaluations en cours (verrou pris). */
+static unsigned long purger(struct cache *c)
+{
+	unsigned long plus_ancienne = c->generation;
+	for (const struct evaluation *ev = c->en_cours; ev != NULL; ev = ev->suivante) {
+		if (ev->generation < plus_ancienne)
+			plus_ancienne = ev->generation;
+	}
+
+	unsigned long nb = 0;
+	for (size_t k = 0; k < c->nb_alveoles; ++k) {
+		struct entree **e = &c->alveoles[k];
+		while (*e != NULL) {
+			if ((*e)->generation < plus_ancienne) {
+				struct entree *morte = *e;
+				*e = morte->suivante;
+				c->octets -= octets_patchwork(morte->patchwork);
+				liberer_patchwork(morte->patchwork);
+				free(morte);
+				c->nb_entrees--;
+				nb++;
+			} else {
+				e = &(*e)->suivante;
+			}
+		}
+	}
+
+	return nb;
+}
+
+
+unsigned long cache_purger(struct cache *c)
+{
+	pthread_mutex_lock(&c->verrou);
+	unsigned long nb = purger(c);
+	pthread_mutex_unlock(&c->verrou);
+	return nb;
+}
+
+
+size_t cache_octets(struct cache *c)
+{
+	pthread_mutex_lock(&c->verrou);
+	size_t octets = c->octets;
+	pthread_mutex_unlock(&c->verrou);
+	return octets;
+}
+
+
+unsigned long cache_succes(struct cache *c)
+{
+	pthread_mutex_lock(&c->verrou);
+	unsigned long succes = c->succes;
+	pthread_mutex_unlock(&c->verrou);
+	return succes;
+}
+
+
+unsigned long cache_echecs(struct cache *c)
+{
+	pthread_mutex_lock(&c->verrou);
+	unsigned long echecs = c->echecs;
+	pthread_mutex_unlock(&c->verrou);
+	return echecs;
+}
+
+
+void liberer_cache(struct cache *c)
+{
+	if (c != NULL) {
+		while (c->en_cours != NULL) {
+			struct evaluation *ev = c->en_cours;
+			c->en_cours = ev->suivante;
+			free(ev);
+		}
+		c->generation++;
+		purger(c);
+		pthread_mutex_destroy(&c->verrou);
+		free(c->alveoles);
+		free(c);
+	}
+}
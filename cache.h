@@ -0,0 +1,61 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include "patchwork.h"
+
+/* Cache de patchworks evalues, indexe par l'empreinte structurelle des
+ * sous-expressions (cf. empreinte_expression dans ast.h) : deux
+ * sous-arbres de meme structure ont la meme empreinte et donc le meme
+ * patchwork, qui n'est evalue qu'une fois.
+ * Les patchworks du cache lui appartiennent : ils sont liberes par
+ * cache_purger et liberer_cache.
+ * Toutes les fonctions peuvent etre appelees par plusieurs fils a la fois,
+ * sauf liberer_cache. */
+struct cache;
+
+/* Cree et retourne un cache vide, ou NULL si l'allocation echoue. */
+extern struct cache *creer_cache(void);
+
+/* Retourne le patchwork d'empreinte donnee (marque comme utilise par la
+ * generation courante), ou NULL s'il est absent. */
+extern struct patchwork *cache_chercher(struct cache *c, uint64_t empreinte);
+
+/* Ajoute au cache le patchwork p d'empreinte donnee ; le cache en devient
+ * proprietaire. Retourne 0, ou -1 si l'ajout echoue (p reste alors a
+ * l'appelant). */
+extern int cache_ajouter(struct cache *c, uint64_t empreinte, struct patchwork *p);
+
+/* Marque l'entree d'empreinte donnee comme utilisee par la generation
+ * courante, sans compter de recherche. Retourne 1 si elle existe, 0 sinon. */
+extern int cache_garder(struct cache *c, uint64_t empreinte);
+
+/* Commence une nouvelle generation : les entrees qui n'y seront ni
+ * cherchees ni ajoutees seront liberees par cache_purger. */
+extern void cache_nouvelle_generation(struct cache *c);
+
+/* Commence une evaluation concurrente des autres : une nouvelle
+ * generation, dont les entrees (cherchees ou ajoutees pendant
+ * l'evaluation) ne sont pas liberees par cache_purger avant
+ * cache_terminer, meme si d'autres generations ont commence depuis.
+ * Retourne le numero de la generation, ou 0 si l'allocation echoue. */
+extern unsigned long cache_commencer(struct cache *c);
+
+/* Termine l'evaluation commencee par cache_commencer. */
+extern void cache_terminer(struct cache *c, unsigned long generation);
+
+/* Libere les entrees non utilisees par la generation courante ni par une
+ * evaluation en cours. Retourne le nombre d'entrees liberees. */
+extern unsigned long cache_purger(struct cache *c);
+
+/* Memoire occupee par les patchworks du cache, en octets. */
+extern size_t cache_octets(struct cache *c);
+
+/* Nombre de recherches fructueuses et infructueuses depuis la creation. */
+extern unsigned long cache_succes(struct cache *c);
+extern unsigned long cache_echecs(struct cache *c);
+
+/* Libere le cache et tous ses patchworks. */
+extern void liberer_cache(struct cache *c);
+
+#endif /* CACHE_H */
@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <argp.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Client du mode daemon de testpatch (testpatch --daemon SOCKET) : envoie
+ * une expression, une taille et un format, et enregistre l'image recue
+ * (cf. le protocole decrit dans demon.h). */
+
+/*---------------------------------------------------------------------------*/
+// Lecture de la ligne de commande
+
+const char *argp_program_version = "Patchwork / v1.0";
+const char *argp_program_bug_address = "<aurelien.pepin@ensimag.fr>";
+static char doc[] = "clientpatch -- Rendu d'un patchwork par un daemon testpatch";
+static char args_doc[] = "";
+
+static struct argp_option options[] = {
+	{ "socket", 'S', "patchwork.sock", 0, "Socket Unix du daemon", 0 },
+	{ "file", 'f', "FICHIER", 0, "Chemin vers le fichier d'entrée (par défaut, l'entrée standard)", 0 },
+	{ "size", 's', "32", 0, "Taille (de côté) d'un motif", 0 },
+	{ "output", 'o', "resultat.ppm", 0, "Chemin de l'image produite (- : sortie standard)", 0 },
+	{ "format", 'F', "ppm", 0, "Format de sortie : ppm, qoi, png (par défaut, selon l'extension de la sortie)", 0 },
+	{ 0, 0, 0, 0, 0, 0 }
+};
+
+struct arguments {
+	char *socket;
+	char *input;
+	char *output;
+	uintmax_t size;
+	char *format;
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state) {
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+		case 'S':
+			arguments->socket = arg;
+			break;
+		case 'f':
+			arguments->input = arg;
+			break;
+		case 's':
+			arguments->size = strtoumax(arg, NULL, 10);
+			if (arguments->size == 0 || arguments->size > 4096)
+				argp_usage (state);
+			break;
+		case 'o':
+			arguments->output = arg;
+			break;
+		case 'F':
+			arguments->format = arg;
+			break;
+		case ARGP_KEY_END:
+			if (state->arg_num > 0)
+				argp_usage (state);
+			break;
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp arg_p = { options, parse_opt, args_doc, doc, 0, 0, 0 };
+
+/*---------------------------------------------------------------------------*/
+
+static int ecrire_tout(int fd, const void *octets, size_t n)
+{
+	const unsigned char *p = octets;
+	while (n > 0) {
+		ssize_t k = write(fd, p, n);
+		if (k < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += k;
+		n -= (size_t) k;
+	}
+
+	return 0;
+}
+
+
+static int connecter(const char *chemin)
+{
+	struct sockaddr_un adresse;
+	memset(&adresse, 0, sizeof (adresse));
+	adresse.sun_family = AF_UNIX;
+	if (strlen(chemin) >= sizeof (adresse.sun_path))
+		return -1;
+	strcpy(adresse.sun_path, chemin);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr *) &adresse, sizeof (adresse)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+int main(int argc, char **argv)
+{
+	struct arguments arguments;
+	arguments.socket = "patchwork.sock";
+	arguments.input = NULL;
+	arguments.output = "resultat.ppm";
+	arguments.size = 32;
+	arguments.format = NULL;
+
+	argp_parse (&arg_p, argc, argv, 0, 0, &arguments);
+
+	// Format : choisi, sinon d'après l'extension de la sortie
+	if (arguments.format == NULL) {
+		const char *extension = strrchr(arguments.output, '.');
+		arguments.format = (extension != NULL && (strcmp(extension, ".qoi") == 0
+												  || strcmp(extension, ".png") == 0))
+			? (char *) extension + 1 : "ppm";
+	}
+
+	FILE *entree = (arguments.input == NULL) ? stdin : fopen(arguments.input, "rb");
+	if (entree == NULL) {
+		fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", arguments.input);
+		return EXIT_FAILURE;
+	}
+
+	int fd = connecter(arguments.socket);
+	if (fd < 0) {
+		fprintf(stderr, "ERREUR. Pas de daemon sur : %s.\n", arguments.socket);
+		return EXIT_FAILURE;
+	}
+
+	// Requête : en-tête puis expression, jusqu'à la fermeture en écriture.
+	// Le daemon peut refuser la requête avant de l'avoir lue en entier :
+	// l'envoi s'arrête alors et sa réponse est lue quand même.
+	signal(SIGPIPE, SIG_IGN);
+	char entete[64];
+	int n = snprintf(entete, sizeof (entete), "%" PRIuMAX " %s\n", arguments.size, arguments.format);
+	int ok = (ecrire_tout(fd, entete, (size_t) n) == 0);
+
+	unsigned char tampon[65536];
+	size_t k;
+	while (ok && (k = fread(tampon, 1, sizeof (tampon), entree)) > 0)
+		ok = (ecrire_tout(fd, tampon, k) == 0);
+	if (entree != stdin)
+		fclose(entree);
+	shutdown(fd, SHUT_WR);
+
+	// Réponse : ligne d'état, puis l'image
+	FILE *reponse = fdopen(fd, "rb");
+	char etat[256];
+	if (reponse == NULL || fgets(etat, sizeof (etat), reponse) == NULL) {
+		fprintf(stderr, "ERREUR. Pas de réponse du daemon.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!ok || strncmp(etat, "OK ", 3) != 0) {
+		fprintf(stderr, "%s", etat);
+		fclose(reponse);
+		return EXIT_FAILURE;
+	}
+
+	int vers_stdout = (strcmp(arguments.output, "-") == 0);
+	FILE *sortie = vers_stdout ? stdout : fopen(arguments.output, "wb");
+	if (sortie == NULL) {
+		fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", arguments.output);
+		fclose(reponse);
+		return EXIT_FAILURE;
+	}
+
+	while ((k = fread(tampon, 1, sizeof (tampon), reponse)) > 0)
+		ok = ok && (fwrite(tampon, 1, k, sortie) == k);
+	ok = ok && !ferror(reponse);
+
+	fclose(reponse);
+	if (!vers_stdout && fclose(sortie) != 0)
+		ok = 0;
+
+	if (!ok) {
+		fprintf(stderr, "ERREUR. Réception incomplète.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!vers_stdout)
+		printf(":: Patchwork :: Résultat : %s.\n", arguments.output);
+	return EXIT_SUCCESS;
+}
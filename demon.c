@@ -0,0 +1,514 @@
+#define _POSIX_C_SOURCE 200809L	/* mkstemp, sigwait, fdopen */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#ifdef __GLIBC__
+#include <malloc.h>	/* malloc_trim */
+#endif
+#include "demon.h"
+#include "analyse.h"
+#include "cache.h"
+#include "image.h"
+#include "stats.h"
+#include "tuiles.h"
+
+/* Nombre de tailles dont les tuiles restent chargees */
+#define NB_TUILES_DEMON 8
+
+/* Taille maximale (de cote) d'un motif demande */
+#define TAILLE_MAX_DEMON 4096
+
+/* Memoire d'un noeud de l'arbre (noeud et donnees, surcout de l'allocateur
+ * compris). Chaque noeud consomme au moins un caractere de l'expression
+ * ("@", "#", "/" ou un nom de primitif) : la longueur de l'expression est
+ * limitee a limite_requete / OCTETS_PAR_NOEUD */
+#define OCTETS_PAR_NOEUD 160
+
+/* Delai au-dela duquel un client inactif est deconnecte, en secondes */
+#define DELAI_CLIENT 30
+
+/* Pause avant un nouvel accept apres une erreur passagere, en millisecondes */
+#define PAUSE_ACCEPT 100
+
+
+/*---------------------------------------------------------------------------*/
+/*     ETAT PARTAGE PAR LES TRAVAILLEURS                                     */
+/*---------------------------------------------------------------------------*/
+
+/* Tuiles d'une taille, partagees par les requetes en cours de cette taille. */
+struct tuiles_partagees {
+	struct tuiles *tuiles;			/* NULL : emplacement libre */
+	unsigned int utilisateurs;
+	unsigned long utilisation;		/* numero de la derniere requete */
+};
+
+struct demon {
+	const struct config_demon *config;
+	int ecoute;
+	pthread_mutex_t verrou_arret;
+	int arret;
+
+	pthread_mutex_t verrou_tuiles;
+	struct tuiles_partagees tuiles[NB_TUILES_DEMON];
+	unsigned long requetes;
+
+	pthread_mutex_t verrou_purge;
+	struct cache *cache;		/* partage sans verrou (cf. cache.h) */
+};
+
+
+/* Tuiles de cote pixels : deja chargees, ou chargees a la place des tuiles
+ * inutilisees depuis le plus longtemps. Retourne NULL si elles ne peuvent
+ * etre chargees ou si tous les emplacements sont occupes. */
+static struct tuiles *prendre_tuiles(struct demon *d, unsigned int cote)
+{
+	pthread_mutex_lock(&d->verrou_tuiles);
+
+	struct tuiles_partagees *choisi = NULL;
+	for (int k = 0; k < NB_TUILES_DEMON && choisi == NULL; ++k) {
+		if (d->tuiles[k].tuiles != NULL && d->tuiles[k].tuiles->cote == cote)
+			choisi = &d->tuiles[k];
+	}
+
+	// Sinon, un emplacement libre ou le moins recemment utilise
+	if (choisi == NULL) {
+		for (int k = 0; k < NB_TUILES_DEMON && (choisi == NULL || choisi->tuiles != NULL); ++k) {
+			struct tuiles_partagees *t = &d->tuiles[k];
+			if (t->utilisateurs == 0 && (choisi == NULL || t->tuiles == NULL
+										 || t->utilisation < choisi->utilisation))
+				choisi = t;
+		}
+	}
+
+	if (choisi != NULL && (choisi->tuiles == NULL || choisi->tuiles->cote != cote)) {
+		liberer_tuiles(choisi->tuiles);
+
+		char chaine_carre[256];
+		char chaine_triangle[256];
+		chemin_motif(chaine_carre, sizeof (chaine_carre), d->config->carre, "carre", cote);
+		chemin_motif(chaine_triangle, sizeof (chaine_triangle), d->config->triangle,
+					 "triangle", cote);
+		choisi->tuiles = charger_tuiles(chaine_carre, chaine_triangle, cote, d->config->noyau);
+	}
+
+	struct tuiles *res = NULL;
+	if (choisi != NULL && choisi->tuiles != NULL) {
+		choisi->utilisateurs++;
+		choisi->utilisation = ++d->requetes;
+		res = choisi->tuiles;
+	}
+
+	pthread_mutex_unlock(&d->verrou_tuiles);
+	return res;
+}
+
+
+static void rendre_tuiles(struct demon *d, const struct tuiles *tuiles)
+{
+	pthread_mutex_lock(&d->verrou_tuiles);
+	for (int k = 0; k < NB_TUILES_DEMON; ++k) {
+		if (d->tuiles[k].tuiles == tuiles)
+			d->tuiles[k].utilisateurs--;
+	}
+	pthread_mutex_unlock(&d->verrou_tuiles);
+}
+
+
+/* Evaluation par le cache partage. Les evaluations des requetes sont
+ * simultanees : chacune est une generation du cache, dont les entrees ne
+ * sont pas liberees avant sa fin. Le resultat est une copie, propre a la
+ * requete : le cache peut etre purge pendant son rendu. Au-dela de la
+ * limite de memoire du cache, les entrees des requetes precedentes sont
+ * liberees, puis les resultats intermediaires de celle-ci : seul son
+ * resultat est garde, et encore s'il tient dans la limite. */
+static struct patchwork *evaluer_partage(struct demon *d, struct noeud_ast *ast)
+{
+	unsigned long generation = cache_commencer(d->cache);
+	if (generation == 0)
+		return NULL;
+
+	struct patchwork *res = copier_patchwork(evaluer_cache(ast, d->cache));
+	cache_terminer(d->cache, generation);
+
+	// Les purges (mais pas les evaluations) sont serialisees : les etapes
+	// d'une purge ne sont pas melees a celles d'une autre
+	pthread_mutex_lock(&d->verrou_purge);
+
+	if (cache_octets(d->cache) > d->config->limite_cache)
+		cache_purger(d->cache);
+
+	if (cache_octets(d->cache) > d->config->limite_cache) {
+		cache_nouvelle_generation(d->cache);
+		cache_garder(d->cache, empreinte_expression(ast));
+		cache_purger(d->cache);
+	}
+
+	if (cache_octets(d->cache) > d->config->limite_cache) {
+		cache_nouvelle_generation(d->cache);
+		cache_purger(d->cache);
+	}
+
+	pthread_mutex_unlock(&d->verrou_purge);
+	return res;
+}
+
+
+/* Restitution au systeme de la memoire liberee par une requete : les
+ * patchworks intermediaires sont surtout de petites allocations, que
+ * l'allocateur garde sinon dans son tas. */
+static void rendre_memoire(void)
+{
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     TRAITEMENT D'UNE REQUETE                                              */
+/*---------------------------------------------------------------------------*/
+
+static void repondre_erreur(int fd, const char *message)
+{
+	char ligne[256];
+	int n = snprintf(ligne, sizeof (ligne), "ERREUR %s\n", message);
+	if (write(fd, ligne, (size_t) n) < 0) {
+		// Client deja parti : rien a faire
+	}
+}
+
+
+/* Lecture de la ligne d'en-tete "<taille> <format>\n", octet par octet pour
+ * ne rien lire de l'expression. */
+static int lire_entete(int fd, unsigned int *taille, enum format_sortie *format)
+{
+	char ligne[64];
+	size_t n = 0;
+
+	while (n < sizeof (ligne) - 1) {
+		ssize_t k = read(fd, ligne + n, 1);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0)
+			return -1;
+		if (ligne[n] == '\n')
+			break;
+		++n;
+	}
+	ligne[n] = '\0';
+
+	char nom_format[16];
+	if (sscanf(ligne, "%u %15s", taille, nom_format) != 2
+		|| *taille == 0 || *taille > TAILLE_MAX_DEMON)
+		return -1;
+
+	*format = format_depuis_nom(nom_format);
+	return (*format == NB_FORMATS) ? -1 : 0;
+}
+
+
+/* Copie de l'expression dans un fichier temporaire (l'analyseur lit un
+ * fichier), dans la limite de max octets. Retourne 0, ou -1. */
+static int recevoir_expression(int fd, char *chemin, uint64_t max)
+{
+	const char *dossier = getenv("TMPDIR");
+	snprintf(chemin, 4096, "%s/patchwork-XXXXXX", dossier != NULL ? dossier : "/tmp");
+
+	int tmp = mkstemp(chemin);
+	if (tmp < 0)
+		return -1;
+
+	unsigned char tampon[4096];
+	uint64_t total = 0;
+	int ok = 1;
+
+	for (;;) {
+		ssize_t k = read(fd, tampon, sizeof (tampon));
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0) {
+			ok = (k == 0);
+			break;
+		}
+
+		total += (uint64_t) k;
+		if (total > max || write(tmp, tampon, (size_t) k) != k) {
+			ok = 0;
+			break;
+		}
+	}
+
+	if (close(tmp) != 0 || !ok) {
+		unlink(chemin);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Memoire d'une requete : les patchworks de tous les noeuds, que le cache
+ * garde pendant l'evaluation (un tableau de lignes compris, d'au plus un
+ * pointeur par primitif), la copie du resultat, les tuiles et une ligne de
+ * pixels. */
+static uint64_t memoire_requete(const struct noeud_ast *ast, unsigned int cote)
+{
+	const uint64_t par_cellule = sizeof (struct primitif) + sizeof (struct primitif *);
+	uint64_t intermediaires = cellules_totales_expression(ast);
+	uint32_t hauteur, largeur;
+	dimensions_expression(ast, &hauteur, &largeur);
+
+	if (intermediaires > UINT64_MAX / 2 / par_cellule)
+		return UINT64_MAX;
+
+	return (intermediaires + cellules_expression(ast)) * par_cellule
+		+ (uint64_t) NB_NAT_PRIMITIFS * NB_ORIENTATIONS * cote * cote * 4
+		+ (uint64_t) largeur * cote * 3;
+}
+
+
+static void traiter(struct demon *d, int fd)
+{
+	unsigned int taille;
+	enum format_sortie format;
+	char chemin[4096];
+
+	if (lire_entete(fd, &taille, &format) != 0) {
+		repondre_erreur(fd, "en-tete incorrect (attendu : <taille> <format>)");
+		close(fd);
+		return;
+	}
+
+	// L'arbre est construit avant que la limite de memoire puisse etre
+	// appliquee : la longueur de l'expression la borne
+	if (recevoir_expression(fd, chemin, d->config->limite_requete / OCTETS_PAR_NOEUD) != 0) {
+		repondre_erreur(fd, "expression illisible ou trop longue");
+		close(fd);
+		return;
+	}
+
+	struct noeud_ast *ast = analyser_sans_risque(chemin);
+	unlink(chemin);
+	if (ast == NULL) {
+		repondre_erreur(fd, "expression incorrecte");
+		close(fd);
+		return;
+	}
+
+	// Les dimensions et la somme des resultats intermediaires sont connues
+	// avant l'evaluation : la limite de memoire est appliquee sans rien
+	// allouer
+	uint32_t hauteur, largeur;
+	dimensions_expression(ast, &hauteur, &largeur);
+	const char *erreur = NULL;
+	if (hauteur == 0 || largeur == 0)
+		erreur = "dimensions incompatibles";
+	else if (hauteur > UINT16_MAX || largeur > UINT16_MAX)
+		erreur = "patchwork trop grand";
+	else if (memoire_requete(ast, taille) > d->config->limite_requete)
+		erreur = "limite de memoire depassee";
+
+	struct patchwork *patch = NULL;
+	if (erreur == NULL && (patch = evaluer_partage(d, ast)) == NULL)
+		erreur = "evaluation impossible";
+	liberer_expression(ast);
+
+	struct tuiles *tuiles = NULL;
+	if (erreur == NULL && (tuiles = prendre_tuiles(d, taille)) == NULL)
+		erreur = "motifs indisponibles";
+
+	FILE *flux = NULL;
+	struct ecrivain *ecrivain = NULL;
+	if (erreur == NULL && ((flux = fdopen(fd, "wb")) == NULL
+						   || (ecrivain = creer_ecrivain_fichier(flux)) == NULL))
+		erreur = "memoire insuffisante";
+
+	if (erreur != NULL) {
+		repondre_erreur(fd, erreur);
+		if (flux != NULL)
+			fclose(flux);
+		else
+			close(fd);
+	} else {
+		// L'image suit la ligne de reponse ; l'ecrivain ferme la connexion
+		char ligne[64];
+		int n = snprintf(ligne, sizeof (ligne), "OK %u %u\n",
+						 (unsigned int) hauteur * taille, (unsigned int) largeur * taille);
+		ecrivain->ecrire(ecrivain, ligne, (size_t) n);
+
+		char nom[32];
+		const char *noms[1] = { nom };
+		snprintf(nom, sizeof (nom), "requete %d", fd);
+		const struct tuiles *rendu[1] = { tuiles };
+		creer_images_tuiles(patch, rendu, &ecrivain, noms, 1, format, 0);
+	}
+
+	if (tuiles != NULL)
+		rendre_tuiles(d, tuiles);
+	liberer_patchwork(patch);
+	rendre_memoire();
+}
+
+
+static int arrete(struct demon *d)
+{
+	pthread_mutex_lock(&d->verrou_arret);
+	int arret = d->arret;
+	pthread_mutex_unlock(&d->verrou_arret);
+	return arret;
+}
+
+
+static void *travailleur(void *arg)
+{
+	struct demon *d = arg;
+
+	// Compteurs propres au travailleur : les requetes simultanees ne les
+	// partagent pas
+	struct statistiques propres;
+	memset(&propres, 0, sizeof (propres));
+	stats_fil(&propres);
+
+	while (!arrete(d)) {
+		int fd = accept(d->ecoute, NULL, NULL);
+		if (fd < 0) {
+			// Seul l'arret termine le travailleur : les autres erreurs
+			// (descripteurs ou memoire epuises, client parti) sont
+			// passageres, accept est repris apres une pause
+			if (errno != EINTR && errno != ECONNABORTED && !arrete(d)) {
+				struct timespec pause = { 0, PAUSE_ACCEPT * 1000000L };
+				nanosleep(&pause, NULL);
+			}
+			continue;
+		}
+
+		struct timeval delai = { DELAI_CLIENT, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &delai, sizeof (delai));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &delai, sizeof (delai));
+		traiter(d, fd);
+	}
+
+	stats_fil(NULL);
+	return NULL;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     BOUCLE PRINCIPALE                                                     */
+/*---------------------------------------------------------------------------*/
+
+static int ouvrir_socket(const char *chemin)
+{
+	struct sockaddr_un adresse;
+	memset(&adresse, 0, sizeof (adresse));
+	adresse.sun_family = AF_UNIX;
+	if (strlen(chemin) >= sizeof (adresse.sun_path)) {
+		fprintf(stderr, "ERREUR. Chemin de socket trop long : %s.\n", chemin);
+		return -1;
+	}
+	strcpy(adresse.sun_path, chemin);
+
+	// Socket laissee par un daemon precedent
+	struct stat st;
+	if (stat(chemin, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(chemin);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *) &adresse, sizeof (adresse)) != 0
+		|| listen(fd, SOMAXCONN) != 0) {
+		fprintf(stderr, "ERREUR. Impossible d'écouter sur : %s.\n", chemin);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+int servir(const char *chemin_socket, const struct config_demon *config)
+{
+	struct demon d;
+	memset(&d, 0, sizeof (d));
+	d.config = config;
+	pthread_mutex_init(&d.verrou_arret, NULL);
+	pthread_mutex_init(&d.verrou_tuiles, NULL);
+	pthread_mutex_init(&d.verrou_purge, NULL);
+
+	// Le verificateur des expressions est cree tant que le processus n'a
+	// qu'un fil
+	if (demarrer_verification() != 0) {
+		fprintf(stderr, "ERREUR. Impossible de lancer le vérificateur des expressions.\n");
+		return EXIT_FAILURE;
+	}
+
+	// Les travailleurs tiennent chacun leurs compteurs (cf. travailleur)
+	if (stats_par_fil() != 0 || (d.cache = creer_cache()) == NULL) {
+		fprintf(stderr, "ERREUR. Mémoire insuffisante pour le cache.\n");
+		arreter_verification();
+		return EXIT_FAILURE;
+	}
+
+	if ((d.ecoute = ouvrir_socket(chemin_socket)) < 0) {
+		liberer_cache(d.cache);
+		arreter_verification();
+		return EXIT_FAILURE;
+	}
+
+	// Un client qui part pendant l'envoi ne doit pas terminer le daemon ;
+	// SIGINT et SIGTERM ne sont recus que par le fil principal (sigwait)
+	signal(SIGPIPE, SIG_IGN);
+	sigset_t arrets;
+	sigemptyset(&arrets);
+	sigaddset(&arrets, SIGINT);
+	sigaddset(&arrets, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &arrets, NULL);
+
+	unsigned int nb = config->travailleurs;
+	pthread_t fils[nb];
+	unsigned int lances = 0;
+	while (lances < nb && pthread_create(&fils[lances], NULL, travailleur, &d) == 0)
+		++lances;
+
+	int code = EXIT_SUCCESS;
+	if (lances == 0) {
+		fprintf(stderr, "ERREUR. Impossible de lancer les travailleurs.\n");
+		code = EXIT_FAILURE;
+	} else {
+		printf(":: Patchwork :: En attente sur %s (%u travailleurs).\n", chemin_socket, lances);
+		fflush(stdout);
+
+		int signal_recu;
+		sigwait(&arrets, &signal_recu);
+	}
+
+	// Reveil des travailleurs bloques dans accept
+	pthread_mutex_lock(&d.verrou_arret);
+	d.arret = 1;
+	pthread_mutex_unlock(&d.verrou_arret);
+	shutdown(d.ecoute, SHUT_RDWR);
+	for (unsigned int k = 0; k < lances; ++k)
+		pthread_join(fils[k], NULL);
+
+	close(d.ecoute);
+	unlink(chemin_socket);
+	arreter_verification();
+
+	for (int k = 0; k < NB_TUILES_DEMON; ++k)
+		liberer_tuiles(d.tuiles[k].tuiles);
+	liberer_cache(d.cache);
+	pthread_mutex_destroy(&d.verrou_arret);
+	pthread_mutex_destroy(&d.verrou_tuiles);
+	pthread_mutex_destroy(&d.verrou_purge);
+
+	return code;
+}
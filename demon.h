@@ -0,0 +1,33 @@
+#ifndef DEMON_H
+#define DEMON_H
+
+#include <stdint.h>
+#include "reechantillonnage.h"
+
+/* Mode daemon : un processus de longue duree sert les rendus demandes sur
+ * une socket Unix, en gardant chargees les tuiles de chaque taille deja
+ * demandee et, dans un cache partage, les sous-expressions deja evaluees.
+ *
+ * Protocole (une requete par connexion) :
+ *   client -> "<taille> <format>\n" puis le texte de l'expression, jusqu'a
+ *             la fermeture en ecriture de la connexion (shutdown) ;
+ *   daemon -> "OK <hauteur> <largeur>\n" puis les octets de l'image, ou
+ *             "ERREUR <message>\n".
+ * La hauteur et la largeur sont celles de l'image, en pixels. */
+
+struct config_demon {
+	const char *carre;		/* motifs choisis (cf. chemin_motif), ou NULL */
+	const char *triangle;
+	enum noyau_reechantillonnage noyau;
+	unsigned int travailleurs;	/* requetes servies simultanement */
+	uint64_t limite_requete;	/* memoire maximale d'une requete, en octets (arbre
+					 * de l'expression compris) */
+	uint64_t limite_cache;		/* memoire du cache de sous-expressions */
+};
+
+/* Sert les requetes recues sur la socket chemin_socket jusqu'a la reception
+ * de SIGINT ou SIGTERM ; les requetes en cours sont alors terminees.
+ * Retourne EXIT_SUCCESS, ou EXIT_FAILURE si la socket n'a pu etre ouverte. */
+extern int servir(const char *chemin_socket, const struct config_demon *config);
+
+#endif /* DEMON_H */
@@ -0,0 +1,319 @@
+#define _POSIX_C_SOURCE 200809L	/* futimens, st_mtim */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "depot.h"
+#include "stats.h"
+
+/* Signature des fichiers du depot (a changer avec le format) */
+#define MAGIQUE "PWC2"
+#define TAILLE_ENTETE 8
+
+/* Extension des fichiers du depot */
+#define EXTENSION ".pwc"
+
+/* Apres une eviction, le depot est ramene a cette fraction (en %) de sa
+ * taille maximale, pour ne pas reparcourir le dossier a chaque ecriture. */
+#define REMPLISSAGE_APRES_EVICTION 90
+
+struct depot {
+	char *dossier;
+	uint64_t taille_max;
+	uint64_t taille;	/* estimation de la taille totale des fichiers */
+};
+
+
+/* Chemin du fichier d'empreinte donnee. */
+static void chemin_fichier(char *chemin, size_t taille_chemin, const struct depot *d,
+                           uint64_t empreinte)
+{
+	snprintf(chemin, taille_chemin, "%s/%016" PRIx64 EXTENSION, d->dossier, empreinte);
+}
+
+
+static int est_fichier_depot(const char *nom)
+{
+	size_t n = strlen(nom);
+	return n == 16 + strlen(EXTENSION) && strcmp(nom + 16, EXTENSION) == 0;
+}
+
+
+/* Fichier temporaire d'un enregistrement (<empreinte>.pwc.<pid>.tmp), en
+ * cours ou abandonne par une execution interrompue. */
+static int est_temporaire_depot(const char *nom)
+{
+	size_t n = strlen(nom);
+	return n > 16 + strlen(EXTENSION) + 1 + 4 && n < 64
+		&& strncmp(nom + 16, EXTENSION ".", strlen(EXTENSION) + 1) == 0
+		&& strcmp(nom + n - 4, ".tmp") == 0;
+}
+
+
+/* Lecture et ecriture d'un uint16_t petit-boutiste. */
+static uint16_t lire_u16(const unsigned char *octets)
+{
+	return (uint16_t) (octets[0] | octets[1] << 8);
+}
+
+static void ecrire_u16(unsigned char *octets, uint16_t v)
+{
+	octets[0] = (unsigned char) (v & 0xff);
+	octets[1] = (unsigned char) (v >> 8);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     EVICTION DES FICHIERS LES MOINS RECEMMENT UTILISES                    */
+/*---------------------------------------------------------------------------*/
+
+struct fichier {
+	char nom[64];	/* cf. est_fichier_depot, est_temporaire_depot */
+	uint64_t taille;
+	struct timespec utilisation;
+};
+
+static int plus_ancien(const void *a, const void *b)
+{
+	const struct timespec *ta = &((const struct fichier *) a)->utilisation;
+	const struct timespec *tb = &((const struct fichier *) b)->utilisation;
+
+	if (ta->tv_sec != tb->tv_sec)
+		return ta->tv_sec < tb->tv_sec ? -1 : 1;
+	if (ta->tv_nsec != tb->tv_nsec)
+		return ta->tv_nsec < tb->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+
+/* Parcours du dossier : taille totale des fichiers du depot, temporaires
+ * compris, et, si fichiers n'est pas NULL, leur liste (a liberer par
+ * l'appelant). Un temporaire en cours d'ecriture est le plus recent, donc
+ * evince en dernier ; s'il l'est, son enregistrement echoue simplement. */
+static uint64_t parcourir(const struct depot *d, struct fichier **fichiers, size_t *nb)
+{
+	uint64_t total = 0;
+	size_t capacite = 0;
+
+	if (fichiers != NULL) {
+		*fichiers = NULL;
+		*nb = 0;
+	}
+
+	DIR *dir = opendir(d->dossier);
+	if (dir == NULL)
+		return 0;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (!est_fichier_depot(ent->d_name) && !est_temporaire_depot(ent->d_name))
+			continue;
+
+		char chemin[4096];
+		struct stat st;
+		snprintf(chemin, sizeof (chemin), "%s/%s", d->dossier, ent->d_name);
+		if (stat(chemin, &st) != 0)
+			continue;	// supprime entre-temps par une autre execution
+
+		total += (uint64_t) st.st_size;
+		if (fichiers == NULL)
+			continue;
+
+		if (*nb == capacite) {
+			size_t c = capacite ? 2 * capacite : 64;
+			struct fichier *f = realloc(*fichiers, c * sizeof (struct fichier));
+			if (f == NULL)
+				continue;
+			*fichiers = f;
+			capacite = c;
+		}
+
+		struct fichier *f = &(*fichiers)[(*nb)++];
+		memcpy(f->nom, ent->d_name, strlen(ent->d_name) + 1);	// cf. struct fichier
+		f->taille = (uint64_t) st.st_size;
+		f->utilisation = st.st_mtim;
+	}
+
+	closedir(dir);
+	return total;
+}
+
+
+/* Suppression des fichiers les moins recemment utilises jusqu'a revenir
+ * sous REMPLISSAGE_APRES_EVICTION % de la taille maximale. */
+static void evincer(struct depot *d)
+{
+	struct fichier *fichiers;
+	size_t nb;
+	uint64_t total = parcourir(d, &fichiers, &nb);
+	uint64_t cible = d->taille_max / 100 * REMPLISSAGE_APRES_EVICTION;
+
+	qsort(fichiers, nb, sizeof (struct fichier), plus_ancien);
+
+	for (size_t k = 0; k < nb && total > cible; ++k) {
+		char chemin[4096];
+		snprintf(chemin, sizeof (chemin), "%s/%s", d->dossier, fichiers[k].nom);
+		if (unlink(chemin) == 0 || errno == ENOENT)
+			total -= fichiers[k].taille;
+	}
+
+	free(fichiers);
+	d->taille = total;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     OUVERTURE, LECTURE ET ECRITURE                                        */
+/*---------------------------------------------------------------------------*/
+
+struct depot *ouvrir_depot(const char *dossier, uint64_t taille_max)
+{
+	if (mkdir(dossier, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "ERREUR. Impossible de créer le dépôt : %s.\n", dossier);
+		return NULL;
+	}
+
+	struct depot *d = malloc(sizeof (struct depot));
+	if (d == NULL || (d->dossier = strdup(dossier)) == NULL) {
+		fprintf(stderr, "ERREUR. Mémoire insuffisante pour le dépôt.\n");
+		free(d);
+		return NULL;
+	}
+
+	d->taille_max = taille_max;
+	d->taille = parcourir(d, NULL, NULL);
+	if (d->taille > d->taille_max)
+		evincer(d);
+
+	return d;
+}
+
+
+struct patchwork *depot_lire(struct depot *d, uint64_t empreinte,
+                             uint16_t hauteur, uint16_t largeur)
+{
+	char chemin[4096];
+	chemin_fichier(chemin, sizeof (chemin), d, empreinte);
+
+	int fd = open(chemin, O_RDONLY);
+	if (fd < 0) {
+		stats.depot_echecs++;
+		return NULL;
+	}
+
+	struct stat st;
+	const unsigned char *octets = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= TAILLE_ENTETE)
+		octets = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// Fichier utilise : il devient le plus recent pour l'eviction
+	futimens(fd, NULL);
+	close(fd);
+
+	if (octets == MAP_FAILED) {
+		stats.depot_echecs++;
+		return NULL;
+	}
+
+	uint16_t h = lire_u16(octets + 4);
+	uint16_t l = lire_u16(octets + 6);
+
+	// Un fichier d'autres dimensions (collision d'empreintes, fichier
+	// etranger ou perime) est un echec : il sera remplace
+	struct patchwork *p = NULL;
+	if (memcmp(octets, MAGIQUE, 4) == 0 && h == hauteur && l == largeur && h > 0 && l > 0
+		&& (uint64_t) st.st_size == TAILLE_ENTETE + (uint64_t) h * l) {
+		p = creer_patchwork(h, l);
+
+		const unsigned char *cellule = octets + TAILLE_ENTETE;
+		for (uint16_t i = 0; p != NULL && i < h; ++i) {
+			for (uint16_t j = 0; j < l; ++j, ++cellule) {
+				unsigned int nature = *cellule >> 2, orientation = *cellule & 3;
+				if (nature >= NB_NAT_PRIMITIFS) {
+					// Fichier corrompu : il sera reecrit apres evaluation
+					liberer_patchwork(p);
+					p = NULL;
+					break;
+				}
+				p->primitifs[i][j].nature = nature;
+				p->primitifs[i][j].orientation = orientation;
+			}
+		}
+	}
+
+	munmap((void *) octets, (size_t) st.st_size);
+
+	if (p == NULL)
+		stats.depot_echecs++;
+	else
+		stats.depot_succes++;
+	return p;
+}
+
+
+int depot_ecrire(struct depot *d, uint64_t empreinte, const struct patchwork *p)
+{
+	uint64_t taille = TAILLE_ENTETE + (uint64_t) p->hauteur * p->largeur;
+	if (taille > d->taille_max)
+		return -1;	// ne tiendrait pas dans le depot
+
+	char chemin[4096], temporaire[4096 + 32];
+	chemin_fichier(chemin, sizeof (chemin), d, empreinte);
+	snprintf(temporaire, sizeof (temporaire), "%s.%ld.tmp", chemin, (long) getpid());
+
+	FILE *f = fopen(temporaire, "wb");
+	if (f == NULL)
+		return -1;
+
+	unsigned char *ligne = malloc(p->largeur);
+	int ok = (ligne != NULL);
+
+	unsigned char entete[TAILLE_ENTETE];
+	memcpy(entete, MAGIQUE, 4);
+	ecrire_u16(entete + 4, p->hauteur);
+	ecrire_u16(entete + 6, p->largeur);
+	ok = ok && fwrite(entete, 1, TAILLE_ENTETE, f) == TAILLE_ENTETE;
+
+	for (uint16_t i = 0; ok && i < p->hauteur; ++i) {
+		for (uint16_t j = 0; j < p->largeur; ++j)
+			ligne[j] = (unsigned char) (p->primitifs[i][j].nature << 2
+										| p->primitifs[i][j].orientation);
+		ok = (fwrite(ligne, 1, p->largeur, f) == p->largeur);
+	}
+
+	free(ligne);
+	if (fclose(f) != 0)
+		ok = 0;
+
+	// Un fichier remplace (illisible, ou enregistre entre-temps par une
+	// autre execution) ne compte plus dans la taille
+	struct stat st;
+	uint64_t remplace = (stat(chemin, &st) == 0) ? (uint64_t) st.st_size : 0;
+
+	if (!ok || rename(temporaire, chemin) != 0) {
+		unlink(temporaire);
+		return -1;
+	}
+
+	d->taille = (d->taille > remplace) ? d->taille - remplace : 0;
+	d->taille += taille;
+	if (d->taille > d->taille_max)
+		evincer(d);
+
+	return 0;
+}
+
+
+void fermer_depot(struct depot *d)
+{
+	if (d != NULL) {
+		free(d->dossier);
+		free(d);
+	}
+}
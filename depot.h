@@ -0,0 +1,42 @@
+#ifndef DEPOT_H
+#define DEPOT_H
+
+#include <stdint.h>
+#include "patchwork.h"
+
+/* Depot sur disque des patchworks evalues, adresse par le contenu : le
+ * patchwork d'un sous-arbre est enregistre dans le dossier du depot sous
+ * le nom <empreinte>.pwc (cf. empreinte_expression dans ast.h), et peut
+ * ainsi etre relu par une execution ulterieure au lieu d'etre reevalue.
+ *
+ * Format d'un fichier (projetable en memoire avec mmap) :
+ *   "PWC2", hauteur et largeur (uint16_t, petit-boutistes),
+ *   puis hauteur x largeur octets, ligne par ligne : nature << 2 | orientation.
+ *
+ * La taille totale du depot est bornee : au-dela, les fichiers les moins
+ * recemment utilises (date de modification, mise a jour a chaque lecture)
+ * sont supprimes. Les enregistrements passent par un fichier temporaire
+ * renomme, plusieurs executions peuvent donc partager le meme depot ; les
+ * fichiers temporaires abandonnes (execution interrompue) comptent dans la
+ * taille et sont evinces comme les autres. */
+struct depot;
+
+/* Ouvre (et cree au besoin) le depot du dossier donne, d'au plus
+ * taille_max octets. Retourne NULL en cas d'echec, apres un message. */
+extern struct depot *ouvrir_depot(const char *dossier, uint64_t taille_max);
+
+/* Retourne une copie du patchwork d'empreinte donnee et de dimensions
+ * hauteur x largeur, ou NULL s'il est absent du depot, illisible ou de
+ * dimensions differentes (collision d'empreintes, fichier etranger). */
+extern struct patchwork *depot_lire(struct depot *d, uint64_t empreinte,
+                                    uint16_t hauteur, uint16_t largeur);
+
+/* Enregistre le patchwork p sous l'empreinte donnee, puis libere de la
+ * place si la taille maximale est depassee. Retourne 0, ou -1 si
+ * l'enregistrement a echoue (le depot reste utilisable). */
+extern int depot_ecrire(struct depot *d, uint64_t empreinte, const struct patchwork *p);
+
+/* Ferme le depot (les fichiers restent sur le disque). */
+extern void fermer_depot(struct depot *d);
+
+#endif /* DEPOT_H */
@@ -0,0 +1,366 @@
+#define _GNU_SOURCE	/* O_DIRECT */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "ecrivain.h"
+#include "stats.h"
+
+/* Alignement (adresse et taille) exige par O_DIRECT */
+#define ALIGNEMENT_DIRECT 4096
+
+
+/*---------------------------------------------------------------------------*/
+/*     STRUCTURES DES ECRIVAINS                                              */
+/*---------------------------------------------------------------------------*/
+
+struct tampon {
+	unsigned char *octets;
+	size_t rempli;
+};
+
+struct ecrivain_data {
+	// ecrivain synchrone
+	FILE *fichier;
+
+	// ecrivain asynchrone
+	int fd;
+	int direct;
+	const char *chemin;
+	size_t taille;
+	unsigned int nb;
+	struct tampon *tampons;
+	unsigned int courant;		/* tampon en cours de remplissage */
+
+	unsigned int *pleins;		/* file circulaire des tampons a ecrire */
+	unsigned int tete_pleins, nb_pleins;
+	unsigned int *libres;		/* pile des tampons disponibles */
+	unsigned int nb_libres;
+
+	int fin;			/* plus aucun tampon ne sera soumis */
+	int erreur;			/* errno de la premiere ecriture en echec */
+
+	pthread_mutex_t verrou;
+	pthread_cond_t cond_pleins, cond_libres;
+	pthread_t fil;
+};
+
+
+/*---------------------------------------------------------------------------*/
+/*     ECRIVAIN SYNCHRONE (STDIO)                                            */
+/*---------------------------------------------------------------------------*/
+
+static void fichier_ecrire(struct ecrivain *e, const void *octets, size_t n)
+{
+	if (n > 0)
+		fwrite(octets, n, 1, e->data->fichier);
+	stats.octets_ecrits += n;
+}
+
+
+static void *fichier_reserver(struct ecrivain *e, size_t n)
+{
+	(void) e;
+	(void) n;
+	return NULL;
+}
+
+
+static void fichier_valider(struct ecrivain *e, size_t n)
+{
+	(void) e;
+	(void) n;
+}
+
+
+static int fichier_fermer(struct ecrivain *e)
+{
+	int res = ferror(e->data->fichier) ? -1 : 0;
+	if (fclose(e->data->fichier) != 0)
+		res = -1;
+
+	free(e->data);
+	free(e);
+	return res;
+}
+
+
+struct ecrivain *creer_ecrivain_fichier(FILE *f)
+{
+	if (f == NULL)
+		return NULL;
+
+	struct ecrivain *e = malloc(sizeof (struct ecrivain));
+	struct ecrivain_data *data = calloc(1, sizeof (struct ecrivain_data));
+
+	if (e == NULL || data == NULL) {
+		free(e);
+		free(data);
+		return NULL;
+	}
+
+	// Initialisation du contenu de l'ecrivain et branchements
+	data->fichier = f;
+	e->data = data;
+	e->ecrire = &fichier_ecrire;
+	e->reserver = &fichier_reserver;
+	e->valider = &fichier_valider;
+	e->fermer = &fichier_fermer;
+
+	return e;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     ECRIVAIN ASYNCHRONE                                                   */
+/*---------------------------------------------------------------------------*/
+
+/* Ecriture complete d'un tampon (write peut etre partiel ou interrompu). */
+static int ecrire_tout(int fd, const unsigned char *octets, size_t n)
+{
+	while (n > 0) {
+		ssize_t k = write(fd, octets, n);
+		if (k < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		octets += k;
+		n -= (size_t) k;
+	}
+
+	return 0;
+}
+
+
+/* Fil d'execution d'ecriture : vide les tampons pleins dans l'ordre de
+ * soumission et les rend a la reserve. */
+static void *fil_ecriture(void *arg)
+{
+	struct ecrivain_data *d = arg;
+
+	pthread_mutex_lock(&d->verrou);
+	for (;;) {
+		while (d->nb_pleins == 0 && !d->fin)
+			pthread_cond_wait(&d->cond_pleins, &d->verrou);
+
+		if (d->nb_pleins == 0)
+			break;
+
+		unsigned int t = d->pleins[d->tete_pleins];
+		d->tete_pleins = (d->tete_pleins + 1) % d->nb;
+		d->nb_pleins--;
+		int erreur = d->erreur;
+		pthread_mutex_unlock(&d->verrou);
+
+		struct tampon *tampon = &d->tampons[t];
+		if (!erreur) {
+			// Seul le dernier tampon peut etre incomplet : O_DIRECT est alors
+			// retire pour ecrire cette fin de fichier non alignee.
+			if (d->direct && tampon->rempli % ALIGNEMENT_DIRECT != 0)
+				fcntl(d->fd, F_SETFL, fcntl(d->fd, F_GETFL) & ~O_DIRECT);
+			erreur = ecrire_tout(d->fd, tampon->octets, tampon->rempli);
+		}
+
+		pthread_mutex_lock(&d->verrou);
+		if (erreur && !d->erreur)
+			d->erreur = erreur;
+		tampon->rempli = 0;
+		d->libres[d->nb_libres++] = t;
+		pthread_cond_signal(&d->cond_libres);
+	}
+	pthread_mutex_unlock(&d->verrou);
+
+	return NULL;
+}
+
+
+/* Soumission du tampon courant au fil d'ecriture et attente d'un tampon
+ * libre, qui devient le tampon courant. */
+static void soumettre(struct ecrivain_data *d)
+{
+	pthread_mutex_lock(&d->verrou);
+
+	d->pleins[(d->tete_pleins + d->nb_pleins) % d->nb] = d->courant;
+	d->nb_pleins++;
+	pthread_cond_signal(&d->cond_pleins);
+
+	while (d->nb_libres == 0)
+		pthread_cond_wait(&d->cond_libres, &d->verrou);
+	d->courant = d->libres[--d->nb_libres];
+
+	pthread_mutex_unlock(&d->verrou);
+}
+
+
+static void asynchrone_ecrire(struct ecrivain *e, const void *octets, size_t n)
+{
+	struct ecrivain_data *d = e->data;
+	const unsigned char *source = octets;
+
+	stats.octets_ecrits += n;
+	while (n > 0) {
+		struct tampon *t = &d->tampons[d->courant];
+		size_t k = d->taille - t->rempli;
+		if (k > n)
+			k = n;
+
+		memcpy(t->octets + t->rempli, source, k);
+		t->rempli += k;
+		source += k;
+		n -= k;
+
+		if (t->rempli == d->taille)
+			soumettre(d);
+	}
+}
+
+
+static void *asynchrone_reserver(struct ecrivain *e, size_t n)
+{
+	struct ecrivain_data *d = e->data;
+	struct tampon *t = &d->tampons[d->courant];
+
+	// Avec O_DIRECT, seuls des tampons complets peuvent etre soumis
+	if (n > d->taille - t->rempli) {
+		if (d->direct || n > d->taille)
+			return NULL;
+		soumettre(d);
+		t = &d->tampons[d->courant];
+	}
+
+	return t->octets + t->rempli;
+}
+
+
+static void asynchrone_valider(struct ecrivain *e, size_t n)
+{
+	struct ecrivain_data *d = e->data;
+	struct tampon *t = &d->tampons[d->courant];
+
+	t->rempli += n;
+	stats.octets_ecrits += n;
+	if (t->rempli == d->taille)
+		soumettre(d);
+}
+
+
+static void liberer_asynchrone(struct ecrivain *e)
+{
+	struct ecrivain_data *d = e->data;
+
+	for (unsigned int k = 0; d->tampons != NULL && k < d->nb; ++k)
+		free(d->tampons[k].octets);
+	free(d->tampons);
+	free(d->pleins);
+	free(d->libres);
+	pthread_mutex_destroy(&d->verrou);
+	pthread_cond_destroy(&d->cond_pleins);
+	pthread_cond_destroy(&d->cond_libres);
+	free(d);
+	free(e);
+}
+
+
+static int asynchrone_fermer(struct ecrivain *e)
+{
+	struct ecrivain_data *d = e->data;
+
+	pthread_mutex_lock(&d->verrou);
+	if (d->tampons[d->courant].rempli > 0) {
+		d->pleins[(d->tete_pleins + d->nb_pleins) % d->nb] = d->courant;
+		d->nb_pleins++;
+	}
+	d->fin = 1;
+	pthread_cond_signal(&d->cond_pleins);
+	pthread_mutex_unlock(&d->verrou);
+
+	pthread_join(d->fil, NULL);
+
+	int erreur = d->erreur;
+	if (close(d->fd) != 0 && !erreur)
+		erreur = errno;
+
+	if (erreur)
+		fprintf(stderr, "ERREUR. Écriture impossible dans %s : %s.\n", d->chemin, strerror(erreur));
+
+	liberer_asynchrone(e);
+	return erreur ? -1 : 0;
+}
+
+
+struct ecrivain *creer_ecrivain_asynchrone(const char *chemin,
+                                           unsigned int nb_tampons,
+                                           size_t taille_tampon,
+                                           int direct)
+{
+	if (nb_tampons < 2 || taille_tampon == 0)
+		return NULL;
+
+	if (direct)
+		taille_tampon = (taille_tampon + ALIGNEMENT_DIRECT - 1) / ALIGNEMENT_DIRECT * ALIGNEMENT_DIRECT;
+
+	struct ecrivain *e = malloc(sizeof (struct ecrivain));
+	struct ecrivain_data *d = calloc(1, sizeof (struct ecrivain_data));
+
+	if (e == NULL || d == NULL) {
+		free(e);
+		free(d);
+		fprintf(stderr, "ERREUR. Mémoire insuffisante pour les tampons d'écriture.\n");
+		return NULL;
+	}
+
+	// Initialisation du contenu de l'ecrivain et branchements
+	e->data = d;
+	e->ecrire = &asynchrone_ecrire;
+	e->reserver = &asynchrone_reserver;
+	e->valider = &asynchrone_valider;
+	e->fermer = &asynchrone_fermer;
+
+	d->chemin = chemin;
+	d->direct = direct;
+	d->taille = taille_tampon;
+	d->nb = nb_tampons;
+	pthread_mutex_init(&d->verrou, NULL);
+	pthread_cond_init(&d->cond_pleins, NULL);
+	pthread_cond_init(&d->cond_libres, NULL);
+
+	// Reserve de tampons : le premier est le tampon courant
+	d->tampons = calloc(nb_tampons, sizeof (struct tampon));
+	d->pleins = calloc(nb_tampons, sizeof (unsigned int));
+	d->libres = calloc(nb_tampons, sizeof (unsigned int));
+	int ok = (d->tampons != NULL && d->pleins != NULL && d->libres != NULL);
+
+	for (unsigned int k = 0; ok && k < nb_tampons; ++k) {
+		void *octets = NULL;
+		ok = (posix_memalign(&octets, ALIGNEMENT_DIRECT, taille_tampon) == 0);
+		d->tampons[k].octets = octets;
+		if (k > 0)
+			d->libres[d->nb_libres++] = nb_tampons - k;
+	}
+	d->courant = 0;
+
+	if (!ok) {
+		fprintf(stderr, "ERREUR. Mémoire insuffisante pour les tampons d'écriture.\n");
+		liberer_asynchrone(e);
+		return NULL;
+	}
+
+	d->fd = open(chemin, O_WRONLY | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0666);
+	if (d->fd < 0) {
+		fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s (%s).\n", chemin, strerror(errno));
+		liberer_asynchrone(e);
+		return NULL;
+	}
+
+	if (pthread_create(&d->fil, NULL, &fil_ecriture, d) != 0) {
+		fprintf(stderr, "ERREUR. Impossible de lancer le fil d'écriture.\n");
+		close(d->fd);
+		liberer_asynchrone(e);
+		return NULL;
+	}
+
+	return e;
+}
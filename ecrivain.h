@@ -0,0 +1,54 @@
+#ifndef ECRIVAIN_H
+#define ECRIVAIN_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Structure d'un ecrivain : destination des octets produits par les
+ * sorties d'images (cf. sortie.h). Comme pour les noeuds de l'AST, la
+ * partie data est privee ; les "methodes" sont branchees a la creation
+ * selon le type d'ecrivain :
+ *  - ecrivain synchrone sur un FILE * (stdio) ;
+ *  - ecrivain asynchrone : les octets sont accumules dans des tampons d'une
+ *    reserve, vides par un fil d'execution dedie pendant que le rendu
+ *    continue a remplir les suivants. */
+struct ecrivain_data;
+
+struct ecrivain {
+	// donnees privees de l'ecrivain
+	struct ecrivain_data *data;
+
+	/* pointeur vers la fonction d'ecriture de n octets. */
+	void (*ecrire) (struct ecrivain *, const void *octets, size_t n);
+
+	/* pointeur vers la fonction de reservation de n octets contigus dans
+	 * le tampon courant, a remplir directement puis a valider.
+	 * Retourne NULL si l'ecrivain n'a pas de tampons (ou n trop grand) :
+	 * il faut alors passer par ecrire. */
+	void *(*reserver) (struct ecrivain *, size_t n);
+
+	/* pointeur vers la fonction de validation des n octets reserves. */
+	void (*valider) (struct ecrivain *, size_t n);
+
+	/* pointeur vers la fonction de fermeture : vide les tampons, ferme la
+	 * destination et libere l'ecrivain.
+	 * Retourne 0 si toutes les ecritures ont reussi, -1 sinon. */
+	int (*fermer) (struct ecrivain *);
+};
+
+
+/* Cree et retourne un ecrivain synchrone sur le fichier f (ferme par
+ * la methode fermer), ou NULL si f est NULL ou si l'allocation echoue. */
+extern struct ecrivain *creer_ecrivain_fichier(FILE *f);
+
+/* Cree et retourne un ecrivain asynchrone sur le fichier de nom chemin,
+ * cree ou tronque, avec une reserve de nb_tampons tampons de taille_tampon
+ * octets (nb_tampons >= 2). Si direct est vrai, le fichier est ouvert avec
+ * O_DIRECT (tampons alignes, taille arrondie au multiple de 4096 octets).
+ * Retourne NULL en cas d'echec, apres affichage d'un message. */
+extern struct ecrivain *creer_ecrivain_asynchrone(const char *chemin,
+                                                  unsigned int nb_tampons,
+                                                  size_t taille_tampon,
+                                                  int direct);
+
+#endif /* ECRIVAIN_H */
@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L	/* open_memstream */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <argp.h>
+#include <inttypes.h>
+
+/* Generateur d'expressions de patchworks pour les mesures de performance.
+ * Chaque famille est parametree par une taille n ; les primitifs et leurs
+ * rotations sont tires d'un generateur pseudo-aleatoire initialise par la
+ * graine, afin que les expressions soient reproductibles. */
+
+/*---------------------------------------------------------------------------*/
+// Lecture de la ligne de commande
+
+const char *argp_program_version = "Patchwork / v1.0";
+const char *argp_program_bug_address = "<aurelien.pepin@ensimag.fr>";
+static char doc[] = "genexpr -- Génération d'expressions de patchworks pour les mesures\v"
+	"Familles :\n"
+	"  rotations   n rotations successives d'un bloc carré de 64x64 primitifs\n"
+	"  equilibre   arbre équilibré de profondeur n, alternant JUXT et SUPER\n"
+	"  gauche      chaîne de n juxtapositions penchant à gauche\n"
+	"  droite      chaîne de n juxtapositions penchant à droite\n"
+	"  repetitif   bloc de profondeur n dont les quatre quarts sont la même\n"
+	"              sous-expression, répétée textuellement";
+static char args_doc[] = "FAMILLE N";
+
+static struct argp_option options[] = {
+	{ "graine", 'g', "1", 0, "Graine du générateur pseudo-aléatoire", 0 },
+	{ 0, 0, 0, 0, 0, 0 }
+};
+
+struct arguments {
+	char *famille;
+	uintmax_t n;
+	uint64_t graine;
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state) {
+	struct arguments *arguments = state->input;
+
+	switch (key) {
+		case 'g':
+			arguments->graine = strtoumax(arg, NULL, 10);
+			break;
+		case ARGP_KEY_ARG:
+			if (state->arg_num == 0)
+				arguments->famille = arg;
+			else if (state->arg_num == 1)
+				arguments->n = strtoumax(arg, NULL, 10);
+			else
+				argp_usage (state);
+			break;
+		case ARGP_KEY_END:
+			if (state->arg_num < 2)
+				argp_usage (state);
+			break;
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp arg_p = { options, parse_opt, args_doc, doc, 0, 0, 0 };
+
+/*---------------------------------------------------------------------------*/
+// Generation
+
+static uint64_t etat_alea;
+
+/* xorshift64* : suffisant et identique sur toutes les plates-formes. */
+static uint64_t alea(void)
+{
+	etat_alea ^= etat_alea >> 12;
+	etat_alea ^= etat_alea << 25;
+	etat_alea ^= etat_alea >> 27;
+	return etat_alea * 2685821657736338717ULL;
+}
+
+/* Primitif tire au hasard, precede de 0 a 3 rotations. */
+static void primitif(FILE *f)
+{
+	unsigned int rotations = alea() % 4;
+	for (unsigned int k = 0; k < rotations; ++k)
+		fputc('@', f);
+	fputs((alea() % 2) ? "triangle" : "carre", f);
+}
+
+/* Bloc carre de 2^n x 2^n primitifs ; si repete, les quatre quarts sont
+ * la meme sous-expression (ecrite quatre fois). */
+static void bloc(FILE *f, unsigned int n, int repete)
+{
+	if (n == 0) {
+		primitif(f);
+		return;
+	}
+
+	if (repete) {
+		// La sous-expression est generee une fois puis recopiee
+		char *texte = NULL;
+		size_t taille = 0;
+		FILE *memoire = open_memstream(&texte, &taille);
+
+		bloc(memoire, n - 1, repete);
+		fclose(memoire);
+
+		fprintf(f, "((%s # %s) / (%s # %s))", texte, texte, texte, texte);
+		free(texte);
+	} else {
+		fputs("((", f);
+		bloc(f, n - 1, repete);
+		fputs(" # ", f);
+		bloc(f, n - 1, repete);
+		fputs(") / (", f);
+		bloc(f, n - 1, repete);
+		fputs(" # ", f);
+		bloc(f, n - 1, repete);
+		fputs("))", f);
+	}
+}
+
+/* Arbre equilibre de profondeur n : JUXT aux niveaux pairs, SUPER aux
+ * niveaux impairs, de sorte que les dimensions concordent toujours. */
+static void equilibre(FILE *f, unsigned int n)
+{
+	if (n == 0) {
+		primitif(f);
+		return;
+	}
+
+	fputc('(', f);
+	equilibre(f, n - 1);
+	fputs((n % 2 == 0) ? " # " : " / ", f);
+	equilibre(f, n - 1);
+	fputc(')', f);
+}
+
+int main(int argc, char **argv)
+{
+	struct arguments arguments;
+	arguments.famille = NULL;
+	arguments.n = 0;
+	arguments.graine = 1;
+
+	argp_parse (&arg_p, argc, argv, 0, 0, &arguments);
+	etat_alea = arguments.graine ? arguments.graine : 1;
+	unsigned int n = (unsigned int) arguments.n;
+
+	if (strcmp(arguments.famille, "rotations") == 0) {
+		for (unsigned int k = 0; k < n; ++k)
+			putchar('@');
+		bloc(stdout, 6, 0);
+	} else if (strcmp(arguments.famille, "equilibre") == 0) {
+		equilibre(stdout, n);
+	} else if (strcmp(arguments.famille, "gauche") == 0) {
+		// L'analyseur associe a gauche : a # b # c = (a # b) # c
+		primitif(stdout);
+		for (unsigned int k = 1; k < n; ++k) {
+			printf(" # ");
+			primitif(stdout);
+		}
+	} else if (strcmp(arguments.famille, "droite") == 0) {
+		for (unsigned int k = 1; k < n; ++k) {
+			primitif(stdout);
+			printf(" # (");
+		}
+		primitif(stdout);
+		for (unsigned int k = 1; k < n; ++k)
+			putchar(')');
+	} else if (strcmp(arguments.famille, "repetitif") == 0) {
+		bloc(stdout, n, 1);
+	} else {
+		fprintf(stderr, "ERREUR. Famille inconnue : %s.\n", arguments.famille);
+		return EXIT_FAILURE;
+	}
+
+	putchar('\n');
+	return EXIT_SUCCESS;
+}
@@ -1,44 +1,43 @@
 #include "image.h"
-#define PPMREADBUFLEN 256
+#include "motif.h"
+#include "stats.h"
 
+/* Mémoire maximale des lignes de pixels gardées pour être réémises
+ * (lignes de primitifs répétées), toutes sorties confondues */
+#define MEMOIRE_LIGNES_MAX ((size_t) 64 << 20)
 
-/* Sauvegarde d'une image PPM
- * sous la forme d'un tableau à deux dimensions de pixels. */
-struct motif_pixel {
-    unsigned char R;
-    unsigned char V;
-    unsigned char B;
-};
+/* Rendu par blocs : mémoire maximale des blocs rendus gardés, par sortie */
+#define MEMOIRE_BLOCS_MAX ((size_t) 64 << 20)
 
-struct motif {
-    unsigned int hauteur;
-    unsigned int largeur;
-    struct motif_pixel **pixels;    // Tableau de dimensions hauteur x largeur
-};
 
+/* Génération de plusieurs images à partir des directives d'un patchwork. */
+void image_from_patchwork(struct sortie **, const struct patchwork *, const struct tuiles **,
+                          int, unsigned int);
 
-/* Vérification des motifs.
- * Renvoie : taille si correcte, -1 si problème. */
-int ppm_verifications(FILE *, FILE *, struct motif *, struct motif *);
+/* Génération de plusieurs images à partir d'un patchwork par plages. */
+void image_from_rle(struct sortie **, const struct patchwork_rle *, const struct tuiles **, int);
 
-/* Lecture de la taille d'un PPM/P6.
- * Renvoie : taille si carré, -1 si non carré ou problème. */
-int ppm_caracteristiques(FILE *, struct motif *);
+/* Génération de plusieurs images à partir d'un arbre quaternaire. */
+void image_from_qt(struct sortie **, const struct patchwork_qt *, const struct tuiles **, int);
 
-/* Génération de l'en-tête d'un fichier PPM. */
-void ppm_entete(FILE *, uint16_t, uint16_t);
+/* Tuiles RVB ou indexées selon ce qu'attend la sortie. */
+typedef unsigned char *const (*blocs_tuiles)[NB_ORIENTATIONS];
 
-/* Génération d'un PPM à partir des directives d'un patchwork. */
-void ppm_from_patchwork(FILE *, const struct patchwork *, struct motif *, struct motif *);
+/* Ajout d'une ligne de tuile par primitif de la ligne du patchwork. */
+void ppm_ligne(unsigned char *, const struct primitif *, uint16_t,
+               blocs_tuiles, size_t, unsigned int);
 
-/* Ajout d'un pixel dans le fichier de sortie */
-void ppm_pixel(FILE *, uint16_t, uint16_t, const struct primitif *, struct motif *);
+/* Noyau de rendu d'une ligne de primitifs (cf. ppm_ligne). */
+typedef void (*noyau_ligne)(unsigned char *, const struct primitif *, uint16_t,
+                            blocs_tuiles, size_t, unsigned int);
 
-/* Remplissage d'un tableau avec les données d'un fichier PPM/P6. */
-void ppm_remplir(FILE *, struct motif *);
+/* Noyau spécialisé pour des lignes de tuile de taille_tuile octets, ou
+ * ppm_ligne (générique) s'il n'y en a pas. */
+static noyau_ligne choisir_noyau(size_t taille_tuile);
 
-/* Libère la mémoire prise par un motif et ses pixels. */
-void ppm_liberer(struct motif);
+/* Ajout d'une ligne de tuile par primitif de chaque plage de la ligne. */
+void plages_ligne(unsigned char *, const struct ligne_rle *,
+                  blocs_tuiles, size_t, unsigned int);
 
 /* ============================================================ */
 
@@ -58,202 +57,848 @@ void creer_image(const struct patchwork *patch,
     }
 
     // ETAPE 0. Vérifications des fichiers source.
-    FILE *file_carre, *file_triangle;
     struct motif motif_ppm1, motif_ppm2;
 
-    // unsigned char *data_ppm1 = NULL, *data_ppm2 = NULL;
+    int cote_carre = motif_charger(fichier_ppm_carre, &motif_ppm1);
+    int cote_triangle = motif_charger(fichier_ppm_triangle, &motif_ppm2);
 
-    if ((file_carre = fopen(fichier_ppm_carre, "rb")) == NULL) {
-        fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", fichier_ppm_carre);
+    if (cote_carre < 1 || cote_carre != cote_triangle) {
+        if (cote_carre > 0)
+            ppm_liberer(motif_ppm1);
+        if (cote_triangle > 0)
+            ppm_liberer(motif_ppm2);
+        fprintf(stderr, "ERREUR. Dimensions incohérentes des PPM.");
         return;
     }
 
-    if ((file_triangle = fopen(fichier_ppm_triangle, "rb")) == NULL) {
-        fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", fichier_ppm_carre);
+    // Les motifs ont la bonne taille : les tuiles en sont de simples copies.
+    struct tuiles *tuiles = creer_tuiles(&motif_ppm1, &motif_ppm2, cote_carre, PLUS_PROCHE);
+    ppm_liberer(motif_ppm1);
+    ppm_liberer(motif_ppm2);
+
+    if (tuiles == NULL) {
+        fprintf(stderr, "ERREUR. Mémoire insuffisante pour les motifs.\n");
         return;
     }
 
-    int cote = ppm_verifications(file_carre, file_triangle, &motif_ppm1, &motif_ppm2);
-    if (cote < 1) {
-        fclose(file_carre);
-        fclose(file_triangle);
-        fprintf(stderr, "ERREUR. Dimensions incohérentes des PPM.");
+    creer_image_tuiles(patch, tuiles, fichier_sortie, fichier_nom, FORMAT_PPM);
+    liberer_tuiles(tuiles);
+}
+
+
+/* Cree une image du patchwork patch a partir des tuiles orientees
+ * deja calculees (cf. tuiles.h). */
+void creer_image_tuiles(const struct patchwork *patch,
+                        const struct tuiles *tuiles,
+                        FILE *fichier_sortie,
+                        const char *fichier_nom,
+                        const enum format_sortie format) {
+
+    if (patch == NULL || fichier_sortie == NULL) {
+        fprintf(stderr, "ERREUR. L'expression en entrée est incorrecte.\n");
         return;
     }
 
-    // ETAPE 1. Ecriture de l'en-tête du fichier PPM/P6.
-    uint16_t nb_pixels_hauteur = cote * patch->hauteur;
-    uint16_t nb_pixels_largeur = cote * patch->largeur;
-    ppm_entete(fichier_sortie, nb_pixels_hauteur, nb_pixels_largeur);
+    struct ecrivain *ecrivain = creer_ecrivain_fichier(fichier_sortie);
+    if (ecrivain == NULL) {
+        fprintf(stderr, "ERREUR. Mémoire insuffisante pour l'écriture.\n");
+        fclose(fichier_sortie);
+        return;
+    }
+
+    creer_images_tuiles(patch, &tuiles, &ecrivain, &fichier_nom, 1, format, 0);
+}
+
+
+/* Ouverture des nb flux d'images de h x l primitifs et écriture de leur
+ * en-tête. Retourne 1, ou 0 (après un message) si la mémoire manque. */
+static int ouvrir_flux(struct sortie **flux, uint16_t h, uint16_t l,
+                       const struct tuiles **tuiles, struct ecrivain **ecrivains,
+                       int nb, const enum format_sortie format) {
+
+    int ok = 1;
+    for (int k = 0; k < nb; ++k) {
+        unsigned int nb_pixels_hauteur = tuiles[k]->cote * h;
+        unsigned int nb_pixels_largeur = tuiles[k]->cote * l;
+        flux[k] = creer_sortie(format, ecrivains[k], nb_pixels_hauteur, nb_pixels_largeur,
+                               &tuiles[k]->palette);
+        if (flux[k] == NULL)
+            ok = 0;
+    }
+
+    if (!ok)
+        fprintf(stderr, "ERREUR. Mémoire insuffisante pour l'encodeur de sortie.\n");
+    return ok;
+}
+
+
+/* Fermeture des flux et des écrivains, puis annonce des images produites.
+ * Retourne 0 si toutes les images sont produites, -1 sinon. */
+static int fermer_flux(struct sortie **flux, struct ecrivain **ecrivains, const char **noms,
+                       int nb, int ok) {
+
+    int res = ok ? 0 : -1;
+    for (int k = 0; k < nb; ++k) {
+        fermer_sortie(flux[k]);
+        if (ecrivains[k]->fermer(ecrivains[k]) != 0)
+            res = -1;
+        else if (ok)
+            printf(":: Patchwork :: Résultat : %s.\n", noms[k]);
+    }
+
+    return res;
+}
+
+
+/* Rendu des images d'un patchwork d'une representation quelconque dans
+ * des flux ouverts (cf. image_from_patchwork). */
+typedef void (*rendu_images)(struct sortie **, const void *, const struct tuiles **,
+                             int, unsigned int);
+
+static void rendu_grille(struct sortie **flux, const void *patch, const struct tuiles **tuiles,
+                         int nb, unsigned int taille_bloc) {
+
+    image_from_patchwork(flux, patch, tuiles, nb, taille_bloc);
+}
+
+static void rendu_rle(struct sortie **flux, const void *patch, const struct tuiles **tuiles,
+                      int nb, unsigned int taille_bloc) {
+
+    (void) taille_bloc;
+    image_from_rle(flux, patch, tuiles, nb);
+}
+
+static void rendu_qt(struct sortie **flux, const void *patch, const struct tuiles **tuiles,
+                     int nb, unsigned int taille_bloc) {
+
+    (void) taille_bloc;
+    image_from_qt(flux, patch, tuiles, nb);
+}
+
+
+/* Partie commune aux representations : patchwork absent (expression
+ * incorrecte), ouverture des flux d'images de h x l primitifs, rendu,
+ * puis fermeture. Retourne 0, ou -1 si une image n'a pu etre produite. */
+static int creer_images(const void *patch, uint16_t h, uint16_t l, rendu_images rendu,
+                         const struct tuiles **tuiles, struct ecrivain **ecrivains,
+                         const char **noms, int nb, const enum format_sortie format,
+                         unsigned int taille_bloc) {
+
+    if (patch == NULL) {
+        fprintf(stderr, "ERREUR. L'expression en entrée est incorrecte.\n");
+        for (int k = 0; k < nb; ++k)
+            ecrivains[k]->fermer(ecrivains[k]);
+        return -1;
+    }
+
+    // ETAPE 1. Ouverture des flux et écriture de l'en-tête de chaque fichier.
+    struct sortie *flux[nb];
+    int ok = ouvrir_flux(flux, h, l, tuiles, ecrivains, nb, format);
 
     // ETAPE 2. Traduction du patchwork.
-    ppm_from_patchwork(fichier_sortie, patch, &motif_ppm1, &motif_ppm2);
+    if (ok)
+        rendu(flux, patch, tuiles, nb, taille_bloc);
 
-    // Libération des ressources en mémoire
-    printf(":: Patchwork :: Résultat : %s.\n", fichier_nom);
-    ppm_liberer(motif_ppm1);
-    ppm_liberer(motif_ppm2);
+    return fermer_flux(flux, ecrivains, noms, nb, ok);
+}
+
+
+/* Cree nb images du patchwork patch en un seul parcours de sa grille. */
+int creer_images_tuiles(const struct patchwork *patch,
+                        const struct tuiles **tuiles,
+                        struct ecrivain **ecrivains,
+                        const char **noms,
+                        int nb,
+                        const enum format_sortie format,
+                        unsigned int taille_bloc) {
 
-    fclose(file_carre);
-    fclose(file_triangle);
-    fclose(fichier_sortie);
+    return creer_images(patch, patch != NULL ? patch->hauteur : 0,
+                        patch != NULL ? patch->largeur : 0,
+                        rendu_grille, tuiles, ecrivains, noms, nb, format, taille_bloc);
 }
 
+
+/* Cree nb images du patchwork par plages patch. */
+int creer_images_tuiles_rle(const struct patchwork_rle *patch,
+                            const struct tuiles **tuiles,
+                            struct ecrivain **ecrivains,
+                            const char **noms,
+                            int nb,
+                            const enum format_sortie format) {
+
+    return creer_images(patch, patch != NULL ? patch->hauteur : 0,
+                        patch != NULL ? patch->largeur : 0,
+                        rendu_rle, tuiles, ecrivains, noms, nb, format, 0);
+}
+
+
+/* Cree nb images du patchwork par arbre quaternaire patch. */
+int creer_images_tuiles_qt(const struct patchwork_qt *patch,
+                           const struct tuiles **tuiles,
+                           struct ecrivain **ecrivains,
+                           const char **noms,
+                           int nb,
+                           const enum format_sortie format) {
+
+    return creer_images(patch, patch != NULL ? patch->hauteur : 0,
+                        patch != NULL ? patch->largeur : 0,
+                        rendu_qt, tuiles, ecrivains, noms, nb, format, 0);
+}
+
+
 /* ============================================================ */
 
-/* Vérification des motifs.
- * Renvoie : taille si correcte, NULL si problème. */
-int ppm_verifications(FILE *ppm1, FILE *ppm2, struct motif *motif1, struct motif *motif2) {
-    int taille_ppm1 = ppm_caracteristiques(ppm1, motif1);
-    int taille_ppm2 = ppm_caracteristiques(ppm2, motif2);
+/* Empreinte d'une ligne de primitifs (FNV-1a sur nature et orientation). */
+static uint64_t empreinte_ligne(const struct primitif *primitifs, uint16_t largeur) {
 
-    int res = ((taille_ppm1 > 0) && (taille_ppm2 > 0) && (taille_ppm1 == taille_ppm2));
-    return res ? taille_ppm1 : -1;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint16_t j = 0; j < largeur; ++j)
+        h = (h ^ (uint64_t) (primitifs[j].nature << 2 | primitifs[j].orientation))
+            * 0x100000001b3ULL;
+    return h;
 }
 
 
-/* Lecture de la taille d'un PPM/P6.
- * Inspiré de <https://rosettacode.org/wiki/Bitmap/Read_a_PPM_file#C>
- * Renvoie : taille si carré, -1 si non carré ou problème. */
-int ppm_caracteristiques(FILE *ppm, struct motif *m) {
-    char buf[PPMREADBUFLEN], *t;
-    int r, d, nb_dimensions;
-    unsigned int nb_col, nb_lignes;
+/* Repérage des lignes de primitifs identiques : premiere[i] est la première
+ * ligne égale à la ligne i (i elle-même si elle n'est jamais apparue), et
+ * derniere[p] la dernière ligne égale à la ligne p.
+ * Retourne 0, ou -1 si la mémoire manque. */
+static int reperer_lignes(const struct patchwork *patch, uint16_t *premiere, uint16_t *derniere) {
 
-    t = fgets(buf, PPMREADBUFLEN, ppm);
+    size_t nb_alveoles = 2;
+    while (nb_alveoles < 2 * (size_t) patch->hauteur)
+        nb_alveoles *= 2;
 
-    if ((t == NULL) || ( strncmp(buf, "P6\n", 3) != 0 ))
+    int32_t *alveoles = malloc(nb_alveoles * sizeof (int32_t));
+    uint64_t *empreintes = malloc(patch->hauteur * sizeof (uint64_t));
+    if (alveoles == NULL || empreintes == NULL) {
+        free(alveoles);
+        free(empreintes);
         return -1;
+    }
 
-    do
-    {  /* Elimination des commentaires (lignes commençant par un croisillon). */
-        t = fgets(buf, PPMREADBUFLEN, ppm);
-        if (t == NULL)
-            return -1;
-    } while (strncmp(buf, "#", 1) == 0);
+    memset(alveoles, 0xff, nb_alveoles * sizeof (int32_t));	// -1 : alvéole vide
+    for (uint16_t i = 0; i < patch->hauteur; ++i) {
+        uint64_t h = empreintes[i] = empreinte_ligne(patch->primitifs[i], patch->largeur);
+        size_t a = h & (nb_alveoles - 1);
+
+        // Sondage linéaire ; l'égalité des lignes est vérifiée (collisions)
+        while (alveoles[a] >= 0) {
+            int32_t j = alveoles[a];
+            if (empreintes[j] == h && memcmp(patch->primitifs[j], patch->primitifs[i],
+                                             patch->largeur * sizeof (struct primitif)) == 0)
+                break;
+            a = (a + 1) & (nb_alveoles - 1);
+        }
 
-    nb_dimensions = sscanf(buf, "%u %u", &nb_col, &nb_lignes);
-    if (nb_dimensions < 2)
-        return -1;
+        if (alveoles[a] < 0) {
+            alveoles[a] = i;
+            premiere[i] = derniere[i] = i;
+        } else {
+            premiere[i] = (uint16_t) alveoles[a];
+            derniere[premiere[i]] = i;
+        }
+    }
+
+    free(alveoles);
+    free(empreintes);
+    return 0;
+}
+
+
+/* ============================================================ */
+/* Rendu par blocs de k x k primitifs                           */
+
+/* Bloc de k x k primitifs rendu, identifié par ses primitifs (un octet
+ * nature << 2 | orientation chacun), chaîné dans son alvéole et dans la
+ * liste des blocs du plus au moins récemment utilisé. */
+struct bloc_rendu {
+    uint64_t empreinte;
+    unsigned char *cle;		/* k * k octets */
+    unsigned char *pixels;	/* (k * cote)^2 pixels */
+    unsigned int bande;		/* dernière bande utilisatrice (+ 1) */
+    struct bloc_rendu *suivant_alveole;
+    struct bloc_rendu *precedent, *suivant;
+};
+
+/* Cache LRU des blocs rendus d'une sortie. Un bloc n'y entre qu'à sa
+ * deuxième apparition (empreintes déjà vues, table à correspondance
+ * directe) : les blocs uniques sont rendus sans détour. */
+struct cache_blocs {
+    struct bloc_rendu **alveoles;
+    size_t nb_alveoles;
+    struct bloc_rendu *recent, *ancien;
+    size_t nb, max;
+    size_t taille_cle, taille_pixels;
+    uint64_t *vues;		/* nb_alveoles empreintes */
+};
+
+
+static int creer_cache_blocs(struct cache_blocs *c, unsigned int k, size_t taille_pixels) {
 
-    r = fscanf(ppm, "%u", &d);
-    if ((r < 1) || (d != 255 ))
+    c->taille_cle = (size_t) k * k;
+    c->taille_pixels = taille_pixels;
+    // Un bloc plus grand que le budget n'est jamais gardé (max = 0) : tous
+    // les blocs sont alors rendus directement
+    c->max = MEMOIRE_BLOCS_MAX / (taille_pixels + c->taille_cle + sizeof (struct bloc_rendu));
+
+    c->nb_alveoles = 2;
+    while (c->nb_alveoles < 2 * c->max)
+        c->nb_alveoles *= 2;
+
+    c->alveoles = calloc(c->nb_alveoles, sizeof (struct bloc_rendu *));
+    c->vues = calloc(c->nb_alveoles, sizeof (uint64_t));
+    c->recent = c->ancien = NULL;
+    c->nb = 0;
+
+    if (c->alveoles == NULL || c->vues == NULL) {
+        free(c->alveoles);
+        free(c->vues);
         return -1;
-    fseek(ppm, 1, SEEK_CUR);
+    }
+    return 0;
+}
 
-    /* Ici, on enregistre les données PPM dans une structure motif. */
-    m->hauteur = nb_lignes;
-    m->largeur = nb_col;
 
-    ppm_remplir(ppm, m);
+static void liberer_cache_blocs(struct cache_blocs *c) {
 
-    rewind(ppm); /* Pour repartir du début ensuite. */
-    return ((nb_dimensions == 2) && (nb_col == nb_lignes)) ? nb_col : -1;
+    struct bloc_rendu *b = c->recent;
+    while (b != NULL) {
+        struct bloc_rendu *suivant = b->suivant;
+        free(b->cle);
+        free(b->pixels);
+        free(b);
+        b = suivant;
+    }
+    free(c->alveoles);
+    free(c->vues);
 }
 
 
-/* Génération de l'en-tête d'un fichier PPM. */
-/* Précondition vérifiée dans "creer_image" : le descripteur existe. */
-void ppm_entete(FILE *fichier_sortie, uint16_t hauteur, uint16_t largeur) {
-    fputs("P6\n", fichier_sortie);
-    fprintf(fichier_sortie, "%u %u\n", largeur, hauteur);
-    fprintf(fichier_sortie, "255\n");
+static void detacher_bloc(struct cache_blocs *c, struct bloc_rendu *b) {
+
+    if (b->precedent != NULL)
+        b->precedent->suivant = b->suivant;
+    else
+        c->recent = b->suivant;
+
+    if (b->suivant != NULL)
+        b->suivant->precedent = b->precedent;
+    else
+        c->ancien = b->precedent;
 }
 
 
-/* Génération d'un PPM à partir des directives d'un patchwork. */
-void ppm_from_patchwork(FILE *f_sortie, const struct patchwork *patch,
-                        struct motif *carre, struct motif *triangle) {
-
-    // Chaque primitif du patch est divisé en "carre->hauteur" pixels
-    for (uint16_t i = 0; i < patch->hauteur * carre->hauteur; ++i) {
-        for (uint16_t j = 0; j < patch->largeur * carre->hauteur; ++j) {
-
-            // Coordonnées du primitif dans le patchwork
-            uint16_t primitif_i = i / carre->hauteur;
-            uint16_t primitif_j = j / carre->largeur;
-            struct primitif prim = patch->primitifs[primitif_i][primitif_j];
-
-            switch (prim.nature) {
-                case CARRE:
-                    ppm_pixel(f_sortie, i % carre->largeur, j % carre->largeur, &prim, carre);
-                    break;
-                case TRIANGLE:
-                    ppm_pixel(f_sortie, i % carre->largeur, j % carre->largeur, &prim, triangle);
-                    break;
-                default:
-                    fclose(f_sortie);
-                    return;
+static void placer_en_tete(struct cache_blocs *c, struct bloc_rendu *b) {
+
+    b->precedent = NULL;
+    b->suivant = c->recent;
+    if (c->recent != NULL)
+        c->recent->precedent = b;
+    else
+        c->ancien = b;
+    c->recent = b;
+}
+
+
+/* Bloc de clé donnée : trouvé (et devenu le plus récent), ou NULL. */
+static struct bloc_rendu *chercher_bloc(struct cache_blocs *c, const unsigned char *cle,
+                                        uint64_t empreinte) {
+
+    struct bloc_rendu *b = c->alveoles[empreinte & (c->nb_alveoles - 1)];
+    while (b != NULL && (b->empreinte != empreinte || memcmp(b->cle, cle, c->taille_cle) != 0))
+        b = b->suivant_alveole;
+
+    if (b != NULL && b != c->recent) {
+        detacher_bloc(c, b);
+        placer_en_tete(c, b);
+    }
+    return b;
+}
+
+
+/* Emplacement pour un nouveau bloc de clé donnée (pixels à remplir) : un
+ * nouveau bloc, ou le moins récemment utilisé si le cache est plein et
+ * qu'il ne sert pas à la bande en cours.
+ * Retourne NULL si le bloc ne peut être gardé. */
+static struct bloc_rendu *ajouter_bloc(struct cache_blocs *c, const unsigned char *cle,
+                                       uint64_t empreinte, unsigned int bande) {
+
+    struct bloc_rendu *b;
+    if (c->max == 0)
+        return NULL;
+    if (c->nb == c->max) {
+        b = c->ancien;
+        if (b->bande == bande)
+            return NULL;
+        detacher_bloc(c, b);
+
+        struct bloc_rendu **a = &c->alveoles[b->empreinte & (c->nb_alveoles - 1)];
+        while (*a != b)
+            a = &(*a)->suivant_alveole;
+        *a = b->suivant_alveole;
+    } else {
+        b = malloc(sizeof (struct bloc_rendu));
+        unsigned char *cle_b = malloc(c->taille_cle);
+        unsigned char *pixels = malloc(c->taille_pixels);
+        if (b == NULL || cle_b == NULL || pixels == NULL) {
+            free(b);
+            free(cle_b);
+            free(pixels);
+            return NULL;
+        }
+        b->cle = cle_b;
+        b->pixels = pixels;
+        c->nb++;
+    }
+
+    memcpy(b->cle, cle, c->taille_cle);
+    b->empreinte = empreinte;
+    struct bloc_rendu **a = &c->alveoles[empreinte & (c->nb_alveoles - 1)];
+    b->suivant_alveole = *a;
+    *a = b;
+    placer_en_tete(c, b);
+    return b;
+}
+
+
+/* Génération des images par bandes de k lignes de primitifs, elles-mêmes
+ * découpées en blocs de k x k primitifs. Les blocs de la bande sont d'abord
+ * cherchés dans le cache (ou rendus et ajoutés s'ils ont déjà été vus), puis
+ * chaque ligne de pixels de la bande est construite par une copie par bloc,
+ * sans consulter les tuiles de ses primitifs. Les blocs non gardés (bords,
+ * blocs uniques) sont rendus primitif par primitif.
+ * Retourne 0, ou -1 (sans rien avoir écrit) si la mémoire manque. */
+static int rendu_par_blocs(struct sortie **f_sorties, const struct patchwork *patch,
+                           const struct tuiles **tuiles, int nb, unsigned int k) {
+
+    const unsigned int nb_blocs = (patch->largeur + k - 1) / k;
+    struct cache_blocs caches[nb];
+    unsigned char *lignes[nb];
+    blocs_tuiles blocs[nb];
+    noyau_ligne noyaux[nb];
+    size_t octets[nb];
+    size_t taille_ligne[nb];
+    struct bloc_rendu **bande = malloc(nb_blocs * sizeof (struct bloc_rendu *));
+    unsigned char *cle = malloc((size_t) k * k);
+    int prets = 0, ok = (bande != NULL && cle != NULL);
+
+    for (int s = 0; s < nb; ++s)
+        lignes[s] = NULL;
+
+    for (int s = 0; ok && s < nb; ++s) {
+        size_t cote_bloc = (size_t) k * tuiles[s]->cote;
+        octets[s] = f_sorties[s]->indexee ? 1 : 3;
+        blocs[s] = f_sorties[s]->indexee ? tuiles[s]->indices : tuiles[s]->rvb;
+        noyaux[s] = choisir_noyau(octets[s] * tuiles[s]->cote);
+        taille_ligne[s] = octets[s] * tuiles[s]->cote * patch->largeur;
+
+        ok = ((lignes[s] = malloc(taille_ligne[s])) != NULL
+              && creer_cache_blocs(&caches[s], k, cote_bloc * cote_bloc * octets[s]) == 0);
+        prets += ok;
+    }
+
+    for (unsigned int i0 = 0; ok && i0 < patch->hauteur; i0 += k) {
+        const unsigned int numero = i0 / k + 1;
+        const unsigned int hauteur_bande = (patch->hauteur - i0 < k) ? patch->hauteur - i0 : k;
+
+        for (int s = 0; s < nb; ++s) {
+            struct cache_blocs *c = &caches[s];
+            const unsigned int cote = tuiles[s]->cote;
+            const size_t largeur_tuile = octets[s] * cote;
+            const size_t largeur_bloc = k * largeur_tuile;
+
+            // ETAPE 1. Blocs de la bande : gardés dans le cache, ou NULL
+            for (unsigned int b = 0, j0 = 0; b < nb_blocs; ++b, j0 += k) {
+                bande[b] = NULL;
+                if (c->max == 0 || hauteur_bande < k || patch->largeur - j0 < k)
+                    continue;	// cache sans place, ou bloc incomplet
+
+                uint64_t h = 0xcbf29ce484222325ULL;
+                for (unsigned int a = 0; a < k; ++a) {
+                    const struct primitif *prims = patch->primitifs[i0 + a] + j0;
+                    for (unsigned int x = 0; x < k; ++x) {
+                        unsigned char v = (unsigned char) (prims[x].nature << 2 | prims[x].orientation);
+                        cle[a * k + x] = v;
+                        h = (h ^ v) * 0x100000001b3ULL;
+                    }
+                }
+
+                struct bloc_rendu *bloc = chercher_bloc(c, cle, h);
+                if (bloc != NULL) {
+                    stats.blocs_reutilises++;
+                } else {
+                    uint64_t *vue = &c->vues[h & (c->nb_alveoles - 1)];
+                    if (*vue != h) {
+                        *vue = h;	// première apparition : rendu direct
+                        continue;
+                    }
+                    if ((bloc = ajouter_bloc(c, cle, h, numero)) == NULL)
+                        continue;
+
+                    for (unsigned int a = 0; a < k; ++a) {
+                        for (unsigned int r = 0; r < cote; ++r)
+                            noyaux[s](bloc->pixels + (a * cote + r) * largeur_bloc,
+                                      patch->primitifs[i0 + a] + j0, (uint16_t) k,
+                                      blocs[s], largeur_tuile, r);
+                    }
+                }
+                bloc->bande = numero;
+                bande[b] = bloc;
+            }
+
+            // ETAPE 2. Lignes de pixels de la bande, dans le tampon de
+            // l'écrivain si possible
+            for (unsigned int y = 0; y < hauteur_bande * cote; ++y) {
+                const unsigned int a = y / cote, r = y % cote;
+                unsigned char *ligne = f_sorties[s]->tampon_ligne(f_sorties[s]);
+                if (ligne == NULL)
+                    ligne = lignes[s];
+
+                for (unsigned int b = 0, j0 = 0; b < nb_blocs; ++b, j0 += k) {
+                    unsigned char *dest = ligne + j0 * largeur_tuile;
+                    if (bande[b] != NULL) {
+                        memcpy(dest, bande[b]->pixels + y * largeur_bloc, largeur_bloc);
+                    } else {
+                        unsigned int nb_colonnes = (patch->largeur - j0 < k) ? patch->largeur - j0 : k;
+                        noyaux[s](dest, patch->primitifs[i0 + a] + j0, (uint16_t) nb_colonnes,
+                                  blocs[s], largeur_tuile, r);
+                    }
+                }
+                f_sorties[s]->ecrire_ligne(f_sorties[s], ligne);
+            }
+        }
+    }
+
+    for (int s = 0; s < prets; ++s)
+        liberer_cache_blocs(&caches[s]);
+    for (int s = 0; s < nb; ++s)
+        free(lignes[s]);
+    free(bande);
+    free(cle);
+
+    return ok ? 0 : -1;
+}
+
+
+/* Génération de plusieurs images à partir des directives d'un patchwork :
+ * la grille est parcourue une seule fois, chaque ligne de primitifs
+ * produisant ses lignes de pixels dans chacune des sorties. Les sorties
+ * indexées reçoivent des indices de palette (1 octet par pixel).
+ *
+ * Une ligne de primitifs qui réapparaît plus bas (frises, symétries) n'est
+ * rendue qu'une fois : ses "cote" lignes de pixels sont gardées jusqu'à sa
+ * dernière occurrence, et simplement réémises pour les suivantes, dans la
+ * limite de MEMOIRE_LIGNES_MAX octets. */
+void image_from_patchwork(struct sortie **f_sorties, const struct patchwork *patch,
+                        const struct tuiles **tuiles, int nb, unsigned int taille_bloc) {
+
+    if (taille_bloc >= 2 && rendu_par_blocs(f_sorties, patch, tuiles, nb, taille_bloc) == 0)
+        return;
+
+    // Une ligne de pixels par image : "cote" pixels par primitif
+    unsigned char **lignes = calloc(nb, sizeof (unsigned char *));
+    unsigned char **rendues[nb];	// lignes de pixels gardées, par ligne de primitifs
+    blocs_tuiles blocs[nb];
+    noyau_ligne noyaux[nb];
+    size_t octets[nb];
+    size_t taille_ligne[nb];
+    uint16_t *premiere = malloc(patch->hauteur * sizeof (uint16_t));
+    uint16_t *derniere = malloc(patch->hauteur * sizeof (uint16_t));
+    int ok = (lignes != NULL && premiere != NULL && derniere != NULL
+              && reperer_lignes(patch, premiere, derniere) == 0);
+
+    for (int k = 0; k < nb; ++k)
+        rendues[k] = NULL;
+
+    for (int k = 0; ok && k < nb; ++k) {
+        octets[k] = f_sorties[k]->indexee ? 1 : 3;
+        blocs[k] = f_sorties[k]->indexee ? tuiles[k]->indices : tuiles[k]->rvb;
+        noyaux[k] = choisir_noyau(octets[k] * tuiles[k]->cote);
+        taille_ligne[k] = octets[k] * tuiles[k]->cote * patch->largeur;
+        lignes[k] = malloc(taille_ligne[k]);
+        rendues[k] = calloc(patch->hauteur, sizeof (unsigned char *));
+        ok = (lignes[k] != NULL && rendues[k] != NULL);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "ERREUR. Mémoire insuffisante pour le rendu.\n");
+    } else {
+        size_t memoire = 0;
+
+        // Chaque primitif du patch est divisé en "cote" lignes de pixels
+        for (uint16_t i = 0; i < patch->hauteur; ++i) {
+            uint16_t p = premiere[i];
+
+            for (int k = 0; k < nb; ++k) {
+                unsigned int cote = tuiles[k]->cote;
+                size_t taille_bloc = cote * taille_ligne[k];
+
+                // Ligne déjà rendue : ses lignes de pixels sont réémises
+                if (rendues[k][p] != NULL) {
+                    for (unsigned int r = 0; r < cote; ++r)
+                        f_sorties[k]->ecrire_ligne(f_sorties[k], rendues[k][p] + r * taille_ligne[k]);
+                    stats.lignes_reutilisees += cote;
+
+                    if (derniere[p] == i) {
+                        free(rendues[k][p]);
+                        rendues[k][p] = NULL;
+                        memoire -= taille_bloc;
+                    }
+                    continue;
+                }
+
+                // Ligne à rendre, gardée si elle réapparaît plus bas
+                unsigned char *bloc = NULL;
+                if (derniere[p] > i && memoire + taille_bloc <= MEMOIRE_LIGNES_MAX
+                    && (bloc = malloc(taille_bloc)) != NULL)
+                    memoire += taille_bloc;
+
+                for (unsigned int r = 0; r < cote; ++r) {
+                    // La ligne est construite dans le tampon de l'écrivain si possible
+                    unsigned char *ligne = (bloc != NULL) ? bloc + r * taille_ligne[k]
+                                                          : f_sorties[k]->tampon_ligne(f_sorties[k]);
+                    if (ligne == NULL)
+                        ligne = lignes[k];
+
+                    noyaux[k](ligne, patch->primitifs[i], patch->largeur,
+                              blocs[k], octets[k] * cote, r);
+                    f_sorties[k]->ecrire_ligne(f_sorties[k], ligne);
+                }
+                rendues[k][p] = bloc;
             }
         }
     }
+
+    for (int k = 0; k < nb; ++k) {
+        for (uint16_t i = 0; rendues[k] != NULL && i < patch->hauteur; ++i)
+            free(rendues[k][i]);
+        free(rendues[k]);
+    }
+    for (int k = 0; lignes != NULL && k < nb; ++k)
+        free(lignes[k]);
+    free(lignes);
+    free(premiere);
+    free(derniere);
 }
 
 
-void ppm_pixel(FILE *f_sortie, uint16_t i, uint16_t j, const struct primitif *prim, struct motif *m) {
-    // Les pixels à dessiner sont affectés par l'orientation
-    uint16_t draw_i, draw_j;
-
-    switch (prim->orientation) {
-        case EST:
-            draw_i = i;
-            draw_j = j;
-            break;
-        case NORD:
-            draw_i = j;
-            draw_j = m->largeur - i - 1;
-            break;
-        case OUEST:
-            draw_i = j;
-            draw_j = i;
-            break;
-        case SUD:
-            draw_i = m->largeur - j - 1;
-            draw_j = i;
-            break;
-        default:
-            fclose(f_sortie);
-            return;
+/* Génération des images d'un patchwork par plages, ligne par ligne
+ * (cf. image_from_patchwork). */
+void image_from_rle(struct sortie **f_sorties, const struct patchwork_rle *patch,
+                    const struct tuiles **tuiles, int nb) {
+
+    unsigned char *lignes[nb];
+    blocs_tuiles blocs[nb];
+    size_t octets[nb];
+    int ok = 1;
+
+    for (int k = 0; k < nb; ++k) {
+        octets[k] = f_sorties[k]->indexee ? 1 : 3;
+        blocs[k] = f_sorties[k]->indexee ? tuiles[k]->indices : tuiles[k]->rvb;
+        lignes[k] = malloc(octets[k] * tuiles[k]->cote * patch->largeur);
+        ok = ok && (lignes[k] != NULL);
     }
 
-    // Ajout des composantes R, V et B
-    unsigned char R = m->pixels[draw_i][draw_j].R;
-    unsigned char V = m->pixels[draw_i][draw_j].V;
-    unsigned char B = m->pixels[draw_i][draw_j].B;
-    unsigned char couleurs[] = { R, V, B };
+    if (!ok) {
+        fprintf(stderr, "ERREUR. Mémoire insuffisante pour le rendu.\n");
+    } else {
+        for (uint16_t i = 0; i < patch->hauteur; ++i) {
+            for (int k = 0; k < nb; ++k) {
+                unsigned int cote = tuiles[k]->cote;
+
+                for (unsigned int r = 0; r < cote; ++r) {
+                    unsigned char *ligne = f_sorties[k]->tampon_ligne(f_sorties[k]);
+                    if (ligne == NULL)
+                        ligne = lignes[k];
+
+                    plages_ligne(ligne, &patch->lignes[i], blocs[k], octets[k] * cote, r);
+                    f_sorties[k]->ecrire_ligne(f_sorties[k], ligne);
+                }
+            }
+        }
+    }
 
-    fwrite(couleurs, sizeof (couleurs), 1, f_sortie);
+    for (int k = 0; k < nb; ++k)
+        free(lignes[k]);
 }
 
 
-void ppm_remplir(FILE *f_ppm, struct motif *m) {
-    // Un motif est de taille hauteur * largeur.
-    // Chaque case allouée est une structure pixel (R, V, B)
-    m->pixels = calloc(m->hauteur, sizeof (struct motif_pixel *));
-    for (uint16_t i = 0; i < m->hauteur; ++i) {
-        m->pixels[i] = calloc(m->largeur, sizeof (struct motif_pixel));
+/* Deux lignes ont les mêmes plages (champ par champ : les octets de
+ * remplissage de struct plage ne sont pas initialisés). */
+static int memes_plages(const struct ligne_rle *a, const struct ligne_rle *b) {
+
+    if (a->nb != b->nb)
+        return 0;
+
+    for (uint16_t p = 0; p < a->nb; ++p) {
+        if (a->plages[p].longueur != b->plages[p].longueur
+            || a->plages[p].primitif.nature != b->plages[p].primitif.nature
+            || a->plages[p].primitif.orientation != b->plages[p].primitif.orientation)
+            return 0;
     }
+    return 1;
+}
 
-    for (uint16_t i = 0; i < m->hauteur; ++i) {
-        for (uint16_t j = 0; j < m->largeur; ++j) {
-            char R, V, B;
-            fread(&R, 1, 1, f_ppm);
-            fread(&V, 1, 1, f_ppm);
-            fread(&B, 1, 1, f_ppm);
 
-            m->pixels[i][j].R = (unsigned char) R;
-            m->pixels[i][j].V = (unsigned char) V;
-            m->pixels[i][j].B = (unsigned char) B;
+/* Génération des images d'un arbre quaternaire : chaque ligne de primitifs
+ * est lue en plages (cf. ligne_qt) puis rendue comme une ligne de plages.
+ * Les lignes de pixels de la dernière ligne rendue sont gardées (dans la
+ * limite de MEMOIRE_LIGNES_MAX octets) : une ligne de mêmes plages, dans
+ * un carré uniforme par exemple, est réémise sans être rendue. */
+void image_from_qt(struct sortie **f_sorties, const struct patchwork_qt *patch,
+                   const struct tuiles **tuiles, int nb) {
+
+    unsigned char *lignes[nb];
+    unsigned char *gardees[nb];	// lignes de pixels de la ligne précédente
+    blocs_tuiles blocs[nb];
+    size_t octets[nb];
+    size_t taille_ligne[nb];
+    struct ligne_rle courante = { 0, malloc(patch->largeur * sizeof (struct plage)) };
+    struct ligne_rle precedente = { 0, malloc(patch->largeur * sizeof (struct plage)) };
+    size_t memoire = 0;
+    int ok = (courante.plages != NULL && precedente.plages != NULL);
+
+    for (int k = 0; k < nb; ++k) {
+        octets[k] = f_sorties[k]->indexee ? 1 : 3;
+        blocs[k] = f_sorties[k]->indexee ? tuiles[k]->indices : tuiles[k]->rvb;
+        taille_ligne[k] = octets[k] * tuiles[k]->cote * patch->largeur;
+        lignes[k] = malloc(taille_ligne[k]);
+        ok = ok && (lignes[k] != NULL);
+
+        gardees[k] = NULL;
+        if (memoire + tuiles[k]->cote * taille_ligne[k] <= MEMOIRE_LIGNES_MAX
+            && (gardees[k] = malloc(tuiles[k]->cote * taille_ligne[k])) != NULL)
+            memoire += tuiles[k]->cote * taille_ligne[k];
+    }
+
+    if (!ok) {
+        fprintf(stderr, "ERREUR. Mémoire insuffisante pour le rendu.\n");
+    } else {
+        for (uint16_t i = 0; i < patch->hauteur; ++i) {
+            ligne_qt(patch, i, &courante);
+            int identique = (i > 0 && memes_plages(&courante, &precedente));
+
+            for (int k = 0; k < nb; ++k) {
+                unsigned int cote = tuiles[k]->cote;
+
+                // Mêmes plages que la ligne précédente : ses lignes de pixels sont réémises
+                if (identique && gardees[k] != NULL) {
+                    for (unsigned int r = 0; r < cote; ++r)
+                        f_sorties[k]->ecrire_ligne(f_sorties[k], gardees[k] + r * taille_ligne[k]);
+                    stats.lignes_reutilisees += cote;
+                    continue;
+                }
+
+                for (unsigned int r = 0; r < cote; ++r) {
+                    unsigned char *ligne = (gardees[k] != NULL) ? gardees[k] + r * taille_ligne[k]
+                                                                : f_sorties[k]->tampon_ligne(f_sorties[k]);
+                    if (ligne == NULL)
+                        ligne = lignes[k];
+
+                    plages_ligne(ligne, &courante, blocs[k], octets[k] * cote, r);
+                    f_sorties[k]->ecrire_ligne(f_sorties[k], ligne);
+                }
+            }
+
+            struct ligne_rle echange = precedente;
+            precedente = courante;
+            courante = echange;
         }
     }
+
+    for (int k = 0; k < nb; ++k) {
+        free(lignes[k]);
+        free(gardees[k]);
+    }
+    free(courante.plages);
+    free(precedente.plages);
+}
+
+
+/* Ligne r des tuiles RVB de nb primitifs consécutifs. */
+void image_ligne_rvb(unsigned char *ligne, const struct primitif *primitifs, uint16_t nb,
+                     const struct tuiles *tuiles, unsigned int r) {
+
+    choisir_noyau(3 * tuiles->cote)(ligne, primitifs, nb, tuiles->rvb, 3 * tuiles->cote, r);
+}
+
+
+/* Noyaux spécialisés, pour les tailles de motif 4, 15, 32 et 64 en RVB (3
+ * octets par pixel) et en indices de palette (1 octet) : la ligne de tuile
+ * compte N octets, constante connue à la compilation. La copie de taille
+ * constante est déroulée par le compilateur (en quelques mouvements de
+ * registres au lieu d'un appel à memcpy) et les indexations par r et j
+ * deviennent des multiplications par une constante, ou des décalages
+ * pour les puissances de 2. */
+#define NOYAU_LIGNE(N)                                                              \
+    static void ppm_ligne_##N(unsigned char *ligne, const struct primitif *primitifs, \
+                              uint16_t largeur, blocs_tuiles blocs,                 \
+                              size_t taille_tuile, unsigned int r) {                \
+        (void) taille_tuile;                                                        \
+        for (uint16_t j = 0; j < largeur; ++j) {                                    \
+            const struct primitif *prim = &primitifs[j];                            \
+            memcpy(ligne + j * (N), blocs[prim->nature][prim->orientation] + r * (N), (N)); \
+        }                                                                           \
+    }
+
+NOYAU_LIGNE(4)      /* 4 x 1 */
+NOYAU_LIGNE(12)     /* 4 x 3 */
+NOYAU_LIGNE(15)     /* 15 x 1 */
+NOYAU_LIGNE(45)     /* 15 x 3 */
+NOYAU_LIGNE(32)     /* 32 x 1 */
+NOYAU_LIGNE(96)     /* 32 x 3 */
+NOYAU_LIGNE(64)     /* 64 x 1 */
+NOYAU_LIGNE(192)    /* 64 x 3 */
+
+
+static noyau_ligne choisir_noyau(size_t taille_tuile) {
+
+    switch (taille_tuile) {
+        case 4:   return ppm_ligne_4;
+        case 12:  return ppm_ligne_12;
+        case 15:  return ppm_ligne_15;
+        case 45:  return ppm_ligne_45;
+        case 32:  return ppm_ligne_32;
+        case 96:  return ppm_ligne_96;
+        case 64:  return ppm_ligne_64;
+        case 192: return ppm_ligne_192;
+        default:  return ppm_ligne;
+    }
 }
 
 
-/* Libère la mémoire prise par les pixels d'un motif. */
-void ppm_liberer(struct motif m) {
-    for (uint16_t i = 0; i < m.hauteur; ++i) {
-        free(m.pixels[i]);
+/* Ajout de la ligne r de la tuile de chacun des primitifs de la ligne.
+ * Une ligne de tuile compte taille_tuile octets. */
+void ppm_ligne(unsigned char *ligne, const struct primitif *primitifs, uint16_t largeur,
+               blocs_tuiles blocs, size_t taille_tuile, unsigned int r) {
+
+    for (uint16_t j = 0; j < largeur; ++j) {
+        const struct primitif *prim = &primitifs[j];
+        memcpy(ligne + j * taille_tuile,
+               blocs[prim->nature][prim->orientation] + r * taille_tuile,
+               taille_tuile);
     }
+}
+
 
-    free(m.pixels);
+/* Ajout de la ligne r des tuiles des plages de la ligne : la ligne de tuile
+ * est copiée une fois, puis la portion déjà écrite est recopiée à sa suite
+ * (doublant à chaque copie) jusqu'à couvrir la plage. */
+void plages_ligne(unsigned char *ligne, const struct ligne_rle *plages,
+                  blocs_tuiles blocs, size_t taille_tuile, unsigned int r) {
+
+    for (uint16_t k = 0; k < plages->nb; ++k) {
+        const struct plage *plage = &plages->plages[k];
+        size_t total = plage->longueur * taille_tuile;
+
+        memcpy(ligne, blocs[plage->primitif.nature][plage->primitif.orientation] + r * taille_tuile,
+               taille_tuile);
+        for (size_t fait = taille_tuile; fait < total; ) {
+            size_t n = (fait < total - fait) ? fait : total - fait;
+            memcpy(ligne + fait, ligne, n);
+            fait += n;
+        }
+        ligne += total;
+    }
 }
@@ -4,6 +4,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "patchwork.h"
+#include "rle.h"
+#include "quadtree.h"
+#include "tuiles.h"
+#include "sortie.h"
 
 /* Cree une image du patchwork patch, a partir des deux images ppm
  * representant les images primitives carre et triangle.
@@ -15,4 +19,62 @@ extern void creer_image(const struct patchwork *patch,
                         FILE *fichier_sortie,
                         const char *fichier_nom);
 
+/* Cree une image du patchwork patch a partir des tuiles orientees
+ * deja calculees (cf. tuiles.h), dont le cote fixe la taille des primitifs.
+ * Le resultat est enregistre dans ficher_sortie au format donne. */
+extern void creer_image_tuiles(const struct patchwork *patch,
+                               const struct tuiles *tuiles,
+                               FILE *fichier_sortie,
+                               const char *fichier_nom,
+                               const enum format_sortie format);
+
+/* Cree nb images du patchwork patch en un seul parcours de sa grille :
+ * l'image k est rendue avec les tuiles tuiles[k] et ecrite par l'ecrivain
+ * ecrivains[k] (fichier de nom noms[k]) au format donne, puis l'ecrivain
+ * est ferme. Chaque ligne de primitifs est lue une fois puis ecrite a
+ * toutes les tailles.
+ * Si taille_bloc >= 2, la grille est rendue par blocs de taille_bloc x
+ * taille_bloc primitifs, les blocs deja rencontres etant recopies depuis
+ * un cache des blocs rendus ; sinon (0), elle est rendue par lignes.
+ * Retourne 0, ou -1 si une image n'a pu etre produite (patchwork NULL,
+ * memoire insuffisante ou echec d'ecriture). */
+extern int creer_images_tuiles(const struct patchwork *patch,
+                               const struct tuiles **tuiles,
+                               struct ecrivain **ecrivains,
+                               const char **noms,
+                               int nb,
+                               const enum format_sortie format,
+                               unsigned int taille_bloc);
+
+/* Comme creer_images_tuiles, pour un patchwork represente par plages
+ * (cf. rle.h) : chaque plage est rendue par copies successives de la
+ * ligne de sa tuile, sans parcourir ses primitifs un a un. */
+extern int creer_images_tuiles_rle(const struct patchwork_rle *patch,
+                                   const struct tuiles **tuiles,
+                                   struct ecrivain **ecrivains,
+                                   const char **noms,
+                                   int nb,
+                                   const enum format_sortie format);
+
+/* Comme creer_images_tuiles, pour un patchwork represente par arbre
+ * quaternaire (cf. quadtree.h) : chaque ligne est lue en plages en ne
+ * visitant que les feuilles qu'elle traverse, un carre uniforme donnant
+ * une seule plage ; une ligne identique a la precedente (au sein d'un
+ * meme carre uniforme, par exemple) est reemise sans etre rendue. */
+extern int creer_images_tuiles_qt(const struct patchwork_qt *patch,
+                                  const struct tuiles **tuiles,
+                                  struct ecrivain **ecrivains,
+                                  const char **noms,
+                                  int nb,
+                                  const enum format_sortie format);
+
+/* Construit dans ligne la ligne de pixels r (0 <= r < tuiles->cote) des
+ * nb primitifs consecutifs primitifs[0..nb-1], en RVB (3 * cote * nb
+ * octets). Permet de reecrire une portion d'image sans tout rendre. */
+extern void image_ligne_rvb(unsigned char *ligne,
+                            const struct primitif *primitifs,
+                            uint16_t nb,
+                            const struct tuiles *tuiles,
+                            unsigned int r);
+
 #endif /* IMAGE_H */
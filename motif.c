@@ -0,0 +1,135 @@
+#include <string.h>
+#include <stdlib.h>
+#include "motif.h"
+#define PPMREADBUFLEN 256
+
+/* Cote maximal d'un motif source (au-dela, le fichier est refuse) */
+#define PPM_COTE_MAX 8192
+
+
+/* Chargement d'un motif depuis le fichier PPM/P6 de nom chemin.
+ * Renvoie : taille si carré, -1 si non carré ou problème. */
+int motif_charger(const char *chemin, struct motif *m) {
+    FILE *ppm;
+
+    m->hauteur = 0;
+    m->largeur = 0;
+    m->pixels = NULL;
+
+    if ((ppm = fopen(chemin, "rb")) == NULL) {
+        fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", chemin);
+        return -1;
+    }
+
+    int taille = ppm_caracteristiques(ppm, m);
+    fclose(ppm);
+
+    if (taille < 1 && m->pixels != NULL) {
+        ppm_liberer(*m);
+        m->pixels = NULL;
+    }
+
+    return taille;
+}
+
+
+/* Vérification des motifs.
+ * Renvoie : taille si correcte, NULL si problème. */
+int ppm_verifications(FILE *ppm1, FILE *ppm2, struct motif *motif1, struct motif *motif2) {
+    int taille_ppm1 = ppm_caracteristiques(ppm1, motif1);
+    int taille_ppm2 = ppm_caracteristiques(ppm2, motif2);
+
+    int res = ((taille_ppm1 > 0) && (taille_ppm2 > 0) && (taille_ppm1 == taille_ppm2));
+    return res ? taille_ppm1 : -1;
+}
+
+
+/* Lecture de la taille d'un PPM/P6.
+ * Inspiré de <https://rosettacode.org/wiki/Bitmap/Read_a_PPM_file#C>
+ * Renvoie : taille si carré, -1 si non carré, trop grand, tronqué ou
+ * problème. */
+int ppm_caracteristiques(FILE *ppm, struct motif *m) {
+    char buf[PPMREADBUFLEN], *t;
+    int r, nb_dimensions;
+    unsigned int nb_col, nb_lignes, d;
+
+    t = fgets(buf, PPMREADBUFLEN, ppm);
+
+    if ((t == NULL) || ( strncmp(buf, "P6\n", 3) != 0 ))
+        return -1;
+
+    do
+    {  /* Elimination des commentaires (lignes commençant par un croisillon). */
+        t = fgets(buf, PPMREADBUFLEN, ppm);
+        if (t == NULL)
+            return -1;
+    } while (strncmp(buf, "#", 1) == 0);
+
+    nb_dimensions = sscanf(buf, "%u %u", &nb_col, &nb_lignes);
+    if (nb_dimensions < 2)
+        return -1;
+
+    /* Dimensions refusees avant toute allocation. */
+    if ((nb_col != nb_lignes) || (nb_col == 0) || (nb_col > PPM_COTE_MAX))
+        return -1;
+
+    r = fscanf(ppm, "%u", &d);
+    if ((r < 1) || (d != 255 ))
+        return -1;
+    fseek(ppm, 1, SEEK_CUR);
+
+    /* Ici, on enregistre les données PPM dans une structure motif. */
+    m->hauteur = nb_lignes;
+    m->largeur = nb_col;
+
+    int ok = (ppm_remplir(ppm, m) == 0);
+
+    rewind(ppm); /* Pour repartir du début ensuite. */
+    return ok ? (int) nb_col : -1;
+}
+
+
+
+int ppm_remplir(FILE *f_ppm, struct motif *m) {
+    // Un motif est de taille hauteur * largeur.
+    // Chaque case allouée est une structure pixel (R, V, B)
+    m->pixels = calloc(m->hauteur, sizeof (struct motif_pixel *));
+    int ok = (m->pixels != NULL);
+
+    for (unsigned int i = 0; ok && i < m->hauteur; ++i) {
+        m->pixels[i] = calloc(m->largeur, sizeof (struct motif_pixel));
+        ok = (m->pixels[i] != NULL);
+    }
+
+    for (unsigned int i = 0; ok && i < m->hauteur; ++i) {
+        for (unsigned int j = 0; ok && j < m->largeur; ++j) {
+            unsigned char rvb[3];
+            ok = (fread(rvb, 1, 3, f_ppm) == 3);   // Fichier tronqué ?
+
+            m->pixels[i][j].R = rvb[0];
+            m->pixels[i][j].V = rvb[1];
+            m->pixels[i][j].B = rvb[2];
+        }
+    }
+
+    if (!ok) {
+        ppm_liberer(*m);
+        m->pixels = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Libère la mémoire prise par les pixels d'un motif. */
+void ppm_liberer(struct motif m) {
+    if (m.pixels == NULL)
+        return;
+
+    for (unsigned int i = 0; i < m.hauteur; ++i) {
+        free(m.pixels[i]);
+    }
+
+    free(m.pixels);
+}
@@ -0,0 +1,43 @@
+#ifndef MOTIF_H
+#define MOTIF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Sauvegarde d'une image PPM
+ * sous la forme d'un tableau à deux dimensions de pixels. */
+struct motif_pixel {
+    unsigned char R;
+    unsigned char V;
+    unsigned char B;
+};
+
+struct motif {
+    unsigned int hauteur;
+    unsigned int largeur;
+    struct motif_pixel **pixels;    // Tableau de dimensions hauteur x largeur
+};
+
+
+/* Chargement d'un motif depuis le fichier PPM/P6 de nom chemin.
+ * Renvoie : taille si carré, -1 si non carré ou problème. */
+extern int motif_charger(const char *chemin, struct motif *m);
+
+/* Vérification des motifs.
+ * Renvoie : taille si correcte, -1 si problème. */
+extern int ppm_verifications(FILE *, FILE *, struct motif *, struct motif *);
+
+/* Lecture de la taille d'un PPM/P6.
+ * Renvoie : taille si carré, -1 si non carré, trop grand, tronqué ou
+ * problème. */
+extern int ppm_caracteristiques(FILE *, struct motif *);
+
+/* Remplissage d'un tableau avec les données d'un fichier PPM/P6.
+ * Renvoie : 0, ou -1 si une allocation échoue ou si le fichier est tronqué
+ * (rien ne reste alors alloué). */
+extern int ppm_remplir(FILE *, struct motif *);
+
+/* Libère la mémoire prise par un motif et ses pixels. */
+extern void ppm_liberer(struct motif);
+
+#endif /* MOTIF_H */
@@ -0,0 +1,39 @@
+#include <string.h>
+#include "palette.h"
+
+/* Bit marquant une entree occupee de la table de hachage */
+#define PALETTE_OCCUPEE (1u << 24)
+
+
+void palette_vider(struct palette *pal)
+{
+	memset(pal, 0, sizeof (struct palette));
+}
+
+
+int palette_indice(struct palette *pal, const unsigned char *rvb)
+{
+	if (pal->pleine)
+		return -1;
+
+	uint32_t cle = PALETTE_OCCUPEE | (uint32_t) rvb[0] << 16 | (uint32_t) rvb[1] << 8 | rvb[2];
+	uint32_t h = (cle * 2654435761u) >> 22;	// 10 bits de poids fort
+
+	// Sondage lineaire : la table n'est jamais remplie au-dela du quart
+	while (pal->cles[h] != 0) {
+		if (pal->cles[h] == cle)
+			return pal->indices[h];
+		h = (h + 1) % PALETTE_TAILLE_TABLE;
+	}
+
+	if (pal->nb_couleurs == PALETTE_MAX) {
+		pal->pleine = 1;
+		return -1;
+	}
+
+	pal->cles[h] = cle;
+	pal->indices[h] = (uint8_t) pal->nb_couleurs;
+	memcpy(pal->rvb[pal->nb_couleurs], rvb, 3);
+
+	return pal->nb_couleurs++;
+}
@@ -0,0 +1,33 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+/* Nombre maximal de couleurs d'une palette (indices sur 8 bits) */
+#define PALETTE_MAX 256
+
+/* Taille de la table de hachage couleur -> indice (puissance de 2) */
+#define PALETTE_TAILLE_TABLE 1024
+
+/* Palette des couleurs distinctes d'un ensemble de motifs.
+ * Si les motifs comptent plus de PALETTE_MAX couleurs, la palette est
+ * marquee pleine et ne peut servir a une sortie indexee. */
+struct palette {
+	unsigned int nb_couleurs;
+	int pleine;
+	unsigned char rvb[PALETTE_MAX][3];
+
+	// table de hachage : couleur (24 bits, marquee) -> indice
+	uint32_t cles[PALETTE_TAILLE_TABLE];
+	uint8_t indices[PALETTE_TAILLE_TABLE];
+};
+
+/* Initialise une palette vide. */
+extern void palette_vider(struct palette *pal);
+
+/* Retourne l'indice de la couleur rvb (3 octets) dans la palette pal,
+ * en l'y ajoutant si besoin.
+ * Retourne -1 si la palette est (ou devient) pleine. */
+extern int palette_indice(struct palette *pal, const unsigned char *rvb);
+
+#endif /* PALETTE_H */
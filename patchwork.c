@@ -1,21 +1,182 @@
+#define _POSIX_C_SOURCE 200809L	/* mkstemp, posix_fallocate, posix_madvise */
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "patchwork.h"
+#include "stats.h"
 
+/* Cote des blocs parcourus par la rotation */
+#define BLOC_ROTATION 64
 
-// precond: nat ok, verifiee a la construction
-struct patchwork *creer_primitif(const enum nature_primitif nat)
+/* Taille minimale (en octets de primitifs) d'un patchwork projete : en deca,
+ * un fichier et une projection par patchwork coutent plus qu'ils ne gagnent */
+#define PROJECTION_MIN (1 << 20)
+
+/* Au-dela du budget (en octets de primitifs en memoire), les primitifs
+ * d'un nouveau patchwork sont places dans un fichier temporaire projete.
+ * Les patchworks sont crees et liberes par plusieurs fils (mode daemon) :
+ * la comptabilite du budget est protegee par un verrou, et independante
+ * des statistiques (qui ne sont qu'indicatives). */
+static pthread_mutex_t verrou_budget = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t budget = UINT64_MAX;
+static uint64_t en_memoire = 0;	/* octets de primitifs en memoire vivants */
+
+
+void fixer_budget_patchworks(uint64_t octets)
+{
+	pthread_mutex_lock(&verrou_budget);
+	budget = (octets == 0) ? UINT64_MAX : octets;
+	pthread_mutex_unlock(&verrou_budget);
+}
+
+
+/* Reservation de octets octets du budget : accordee (1) si le patchwork est
+ * petit ou tient dans le budget, refusee (0) sinon. */
+static int reserver(size_t octets)
+{
+	pthread_mutex_lock(&verrou_budget);
+	int accordee = (octets < PROJECTION_MIN || en_memoire + octets <= budget);
+	if (accordee)
+		en_memoire += octets;
+	pthread_mutex_unlock(&verrou_budget);
+	return accordee;
+}
+
+
+static void rendre(size_t octets)
+{
+	pthread_mutex_lock(&verrou_budget);
+	en_memoire -= octets;
+	pthread_mutex_unlock(&verrou_budget);
+}
+
+
+/* Memoire occupee par un patchwork de h x l primitifs. */
+static size_t taille_patchwork(uint16_t h, uint16_t l)
+{
+	return sizeof (struct patchwork)
+		+ h * sizeof (struct primitif *)
+		+ (size_t) h * l * sizeof (struct primitif);
+}
+
+
+/* Projection d'un fichier temporaire (supprime aussitot) de octets octets,
+ * lu et ecrit sequentiellement : le noyau peut evincer les pages deja
+ * parcourues au lieu de manquer de memoire. L'espace est reserve sur le
+ * disque des la creation, pour qu'un disque plein soit une erreur et non
+ * un SIGBUS a l'ecriture. Retourne NULL en cas d'echec. */
+static struct primitif *projeter_primitifs(size_t octets)
 {
+	const char *dossier = getenv("TMPDIR");
+	char chemin[4096];
+	snprintf(chemin, sizeof (chemin), "%s/patchwork-grille-XXXXXX",
+			 dossier != NULL ? dossier : "/tmp");
+
+	int fd = mkstemp(chemin);
+	if (fd < 0)
+		return NULL;
+	unlink(chemin);
+
+	void *primitifs = MAP_FAILED;
+	if (posix_fallocate(fd, 0, (off_t) octets) == 0)
+		primitifs = mmap(NULL, octets, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (primitifs == MAP_FAILED)
+		return NULL;
+
+	posix_madvise(primitifs, octets, POSIX_MADV_SEQUENTIAL);
+	return primitifs;
+}
+
+
+/* Allocation d'un patchwork de h x l primitifs (non initialises), en un
+ * seul bloc de lignes consecutives : en memoire s'il est petit ou dans la
+ * limite du budget, sinon (ou si la memoire manque) projete depuis un
+ * fichier temporaire.
+ * Retourne NULL si ni l'un ni l'autre n'est possible. */
+static struct patchwork *allouer_patchwork(uint16_t h, uint16_t l)
+{
+	size_t octets = (size_t) h * l * sizeof (struct primitif);
 	struct patchwork *pw = malloc(sizeof (struct patchwork));
-	pw->hauteur = 1;
-	pw->largeur = 1;
+	struct primitif **lignes = malloc(h * sizeof (struct primitif *));
+	struct primitif *primitifs = NULL;
+	size_t projection = 0;
+
+	if (pw != NULL && lignes != NULL) {
+		if (reserver(octets) && (primitifs = malloc(octets)) == NULL)
+			rendre(octets);
 
+		if (primitifs == NULL && (primitifs = projeter_primitifs(octets)) != NULL)
+			projection = octets;
+	}
+
+	if (primitifs == NULL) {
+		fprintf(stderr, "ERREUR. Mémoire insuffisante pour un patchwork de %ux%u primitifs.\n",
+				(unsigned int) h, (unsigned int) l);
+		free(pw);
+		free(lignes);
+		return NULL;
+	}
+
+	pw->hauteur = h;
+	pw->largeur = l;
+	pw->primitifs = lignes;
+	pw->projection = projection;
+	for (uint16_t i = 0; i < h; ++i)
+		lignes[i] = primitifs + (size_t) i * l;
+
+	if (projection != 0) {
+		stats.patchworks_projetes++;
+		stats.octets_projetes += projection;
+	}
+
+	stats.allocations += 3;
+	stats.octets_alloues += taille_patchwork(h, l);
+	stats_patchwork(taille_patchwork(h, l));
+
+	return pw;
+}
+
+
+struct patchwork *creer_patchwork(uint16_t h, uint16_t l)
+{
+	return allouer_patchwork(h, l);
+}
+
+
+struct patchwork *copier_patchwork(const struct patchwork *p)
+{
+	if (p == NULL)
+		return NULL;
+
+	struct patchwork *copie = allouer_patchwork(p->hauteur, p->largeur);
+	if (copie == NULL)
+		return NULL;
+
+	for (uint16_t i = 0; i < p->hauteur; ++i)
+		memcpy(copie->primitifs[i], p->primitifs[i], p->largeur * sizeof (struct primitif));
+
+	stats.cellules_copiees += (uint64_t) p->hauteur * p->largeur;
+	return copie;
+}
+
+
+// precond: nat ok, verifiee a la construction
+struct patchwork *creer_primitif(const enum nature_primitif nat)
+{
 	// TODO. Réfléchir s'il est plus avantageux de créer tout de suite un
 	// gros tableau (type 10 * 10) pour éviter les réallocations systématiques
-	pw->primitifs = calloc(1, sizeof (struct primitif *));
-	pw->primitifs[0] = calloc(1, sizeof (struct primitif));
+	struct patchwork *pw = allouer_patchwork(1, 1);
+	if (pw == NULL)
+		return NULL;
 
 	pw->primitifs[0][0].nature = nat;
 	pw->primitifs[0][0].orientation = EST;
 
+	stats.cellules_copiees++;
 	return pw;
 }
 
@@ -27,26 +188,29 @@ struct patchwork *creer_rotation(const struct patchwork *p)
 		return NULL;
 
 	// Une rotation dans le sens direct inverse les dimensions (hauteur, largeur)
-	struct patchwork *nouv_p = malloc(sizeof (struct patchwork));
-	nouv_p->hauteur = p->largeur;
-	nouv_p->largeur = p->hauteur;
-	nouv_p->primitifs = calloc(nouv_p->hauteur, sizeof (struct primitif *));
-
-	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
-		nouv_p->primitifs[i] = calloc(nouv_p->largeur, sizeof (struct primitif));
-	}
+	struct patchwork *nouv_p = allouer_patchwork(p->largeur, p->hauteur);
+	if (nouv_p == NULL)
+		return NULL;
 
 	// Mise à jour de la position des sous-patchworks
 	uint16_t h = nouv_p->hauteur;
 	uint16_t l = nouv_p->largeur;
 
-	for (uint16_t i = 0; i < h; ++i) {
-		for (uint16_t j = 0; j < l; ++j) {
-			nouv_p->primitifs[i][j].nature = p->primitifs[j][h - i - 1].nature;
-			nouv_p->primitifs[i][j].orientation = (p->primitifs[j][h - i - 1].orientation + 1) % NB_ORIENTATIONS;
+	// La colonne h - i - 1 de p est lue de haut en bas : le parcours par blocs
+	// garde les lignes de p lues d'un bloc a l'autre en cache (et en memoire
+	// pour un patchwork projete), au lieu de parcourir tout p par ligne du resultat
+	for (uint32_t i0 = 0; i0 < h; i0 += BLOC_ROTATION) {
+		for (uint32_t j0 = 0; j0 < l; j0 += BLOC_ROTATION) {
+			for (uint32_t i = i0; i < h && i < i0 + BLOC_ROTATION; ++i) {
+				for (uint32_t j = j0; j < l && j < j0 + BLOC_ROTATION; ++j) {
+					nouv_p->primitifs[i][j].nature = p->primitifs[j][h - i - 1].nature;
+					nouv_p->primitifs[i][j].orientation = (p->primitifs[j][h - i - 1].orientation + 1) % NB_ORIENTATIONS;
+				}
+			}
 		}
 	}
 
+	stats.cellules_copiees += (uint64_t) nouv_p->hauteur * nouv_p->largeur;
 	return nouv_p;
 }
 
@@ -60,28 +224,23 @@ struct patchwork *creer_juxtaposition(const struct patchwork *p_g,
 		|| p_g->hauteur != p_d->hauteur)	// Dimensions incompatibles !
 		return NULL;
 
-	struct patchwork *nouv_p = malloc(sizeof (struct patchwork));
-	nouv_p->hauteur = p_g->hauteur;
-	nouv_p->largeur = p_g->largeur + p_d->largeur;
-	nouv_p->primitifs = calloc(nouv_p->hauteur, sizeof (struct primitif *));
+	if ((uint32_t) p_g->largeur + p_d->largeur > UINT16_MAX)	// Trop grand !
+		return NULL;
 
-	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
-		nouv_p->primitifs[i] = calloc(nouv_p->largeur, sizeof (struct primitif));
-	}
+	struct patchwork *nouv_p = allouer_patchwork(p_g->hauteur,
+						     p_g->largeur + p_d->largeur);
+	if (nouv_p == NULL)
+		return NULL;
 
-	// Mise à jour de la position des sous-patchworks
+	// Mise à jour de la position des sous-patchworks : chaque ligne est la
+	// ligne de p_g suivie de celle de p_d
 	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
-		for (uint16_t j = 0; j < nouv_p->largeur; ++j) {
-			if (j < p_g->largeur) {
-				nouv_p->primitifs[i][j].nature = p_g->primitifs[i][j].nature;
-				nouv_p->primitifs[i][j].orientation = p_g->primitifs[i][j].orientation;
-			} else {
-				nouv_p->primitifs[i][j].nature = p_d->primitifs[i][j - p_g->largeur].nature;
-				nouv_p->primitifs[i][j].orientation = p_d->primitifs[i][j - p_g->largeur].orientation;
-			}
-		}
+		memcpy(nouv_p->primitifs[i], p_g->primitifs[i], p_g->largeur * sizeof (struct primitif));
+		memcpy(nouv_p->primitifs[i] + p_g->largeur, p_d->primitifs[i],
+		       p_d->largeur * sizeof (struct primitif));
 	}
 
+	stats.cellules_copiees += (uint64_t) nouv_p->hauteur * nouv_p->largeur;
 	return nouv_p;
 }
 
@@ -95,28 +254,23 @@ struct patchwork *creer_superposition(const struct patchwork *p_h,
 		|| p_h->largeur != p_b->largeur)	// Dimensions incompatibles !
 		return NULL;
 
-	struct patchwork *nouv_p = malloc(sizeof (struct patchwork));
-	nouv_p->hauteur = p_h->hauteur + p_b->hauteur;
-	nouv_p->largeur = p_h->largeur;
-	nouv_p->primitifs = calloc(nouv_p->hauteur, sizeof (struct primitif *));
+	if ((uint32_t) p_h->hauteur + p_b->hauteur > UINT16_MAX)	// Trop grand !
+		return NULL;
 
-	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
-		nouv_p->primitifs[i] = calloc(nouv_p->largeur, sizeof (struct primitif));
-	}
+	struct patchwork *nouv_p = allouer_patchwork(p_h->hauteur + p_b->hauteur,
+						     p_h->largeur);
+	if (nouv_p == NULL)
+		return NULL;
 
-	// Mise à jour de la position des sous-patchworks
+	// Mise à jour de la position des sous-patchworks : les lignes de p_h,
+	// puis celles de p_b
 	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
-		for (uint16_t j = 0; j < nouv_p->largeur; ++j) {
-			if (i < p_h->hauteur) {
-				nouv_p->primitifs[i][j].nature = p_h->primitifs[i][j].nature;
-				nouv_p->primitifs[i][j].orientation = p_h->primitifs[i][j].orientation;
-			} else {
-				nouv_p->primitifs[i][j].nature = p_b->primitifs[i - p_h->hauteur][j].nature;
-				nouv_p->primitifs[i][j].orientation = p_b->primitifs[i - p_h->hauteur][j].orientation;
-			}
-		}
+		const struct primitif *source = (i < p_h->hauteur) ? p_h->primitifs[i]
+		                                                   : p_b->primitifs[i - p_h->hauteur];
+		memcpy(nouv_p->primitifs[i], source, nouv_p->largeur * sizeof (struct primitif));
 	}
 
+	stats.cellules_copiees += (uint64_t) nouv_p->hauteur * nouv_p->largeur;
 	return nouv_p;
 }
 
@@ -124,8 +278,13 @@ struct patchwork *creer_superposition(const struct patchwork *p_h,
 void liberer_patchwork(struct patchwork *patch)
 {
 	if (patch != NULL) {
-		for (uint16_t i = 0; i < patch->hauteur; i++) {
-			free(patch->primitifs[i]);
+		stats_patchwork(-(long long) taille_patchwork(patch->hauteur, patch->largeur));
+
+		if (patch->projection != 0) {
+			munmap(patch->primitifs[0], patch->projection);
+		} else if (patch->hauteur > 0) {
+			free(patch->primitifs[0]);
+			rendre((size_t) patch->hauteur * patch->largeur * sizeof (struct primitif));
 		}
 
 		free(patch->primitifs);
@@ -27,9 +27,28 @@ struct primitif {
 struct patchwork {
 	uint16_t hauteur, largeur;
 	struct primitif **primitifs;	/* tableau de hauteur pointeurs
-					   vers des tableaux de largeur primitifs */
+					   vers des tableaux de largeur primitifs,
+					   consecutifs en un seul bloc */
+	size_t projection;		/* taille du bloc s'il est projete depuis
+					   un fichier temporaire, 0 sinon */
 };
 
+/* Budget de memoire des patchworks, en octets (0 : illimite, par defaut).
+ * Un patchwork qui le ferait depasser, ou que la memoire ne peut contenir,
+ * est place dans un fichier temporaire projete en memoire (dans $TMPDIR,
+ * /tmp par defaut), parcouru sequentiellement : l'evaluation et le rendu
+ * de grilles plus grandes que la memoire physique restent possibles. */
+extern void fixer_budget_patchworks(uint64_t octets);
+
+/* Cree et retourne un patchwork de h x l primitifs, a remplir par
+ * l'appelant (relecture d'un patchwork enregistre, par exemple).
+ * Comme toutes les fonctions suivantes, retourne NULL si la memoire
+ * (et l'espace temporaire) manque. */
+extern struct patchwork *creer_patchwork(uint16_t h, uint16_t l);
+
+/* Cree et retourne une copie du patchwork p (NULL si p est NULL). */
+extern struct patchwork *copier_patchwork(const struct patchwork *p);
+
 /* Cree et retourne un patchwork compose d'une image primitive,
  * de taille 1x1, de nature nat et d'orientation EST. */
 extern struct patchwork *creer_primitif(const enum nature_primitif nat);
@@ -40,13 +59,15 @@ extern struct patchwork *creer_rotation(const struct patchwork *p);
 
 /* Cree et retourne un nouveau patchwork par juxtaposition de p_g et
  * p_d (p_g a gauche de p_d).
- * Si les tailles ne sont par concordantes, retourne NULL. */
+ * Si les tailles ne sont par concordantes, ou si la largeur depasse
+ * UINT16_MAX, retourne NULL. */
 extern struct patchwork *creer_juxtaposition(const struct patchwork *p_g,
                                              const struct patchwork *p_d);
 
 /* Cree et retourne un nouveau patchwork par superposition de p_h et
  * p_b (p_h au dessus de p_b).
- * Si les tailles ne sont par concordantes, retourne NULL. */
+ * Si les tailles ne sont par concordantes, ou si la hauteur depasse
+ * UINT16_MAX, retourne NULL. */
 extern struct patchwork *creer_superposition(const struct patchwork *p_h,
                                              const struct patchwork *p_b);
 
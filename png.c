@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sortie.h"
+
+/* Encodeur en flux du format PNG, sans bibliotheque externe.
+ *
+ * Lorsque les couleurs des motifs tiennent dans une palette, l'image est
+ * indexee (type de couleur 3) sur 1, 2, 4 ou 8 bits par pixel selon le
+ * nombre de couleurs ; sinon elle est en RVB 8 bits (type de couleur 2).
+ * Le flux zlib est forme de blocs deflate "stockes" (non compresses) : le
+ * gain vient de la profondeur reduite, jusqu'a 24 fois moins d'octets que
+ * le RVB pour des motifs en noir et blanc. */
+
+#define PNG_TAILLE_BLOC 65535	/* taille maximale d'un bloc deflate stocke */
+#define ADLER_MOD 65521
+#define ADLER_NMAX 5552
+
+struct sortie_data {
+	int profondeur;		/* bits par pixel */
+	size_t taille_ligne;	/* octets par ligne, octet de filtre compris */
+	unsigned char *ligne;
+
+	// flux zlib en cours : bloc stocke en attente et somme de controle
+	unsigned char *chunk;	/* en-tete zlib + en-tete de bloc + bloc + adler */
+	size_t taille_bloc;
+	int premier_bloc;
+	uint32_t adler_a, adler_b;
+};
+
+
+/*---------------------------------------------------------------------------*/
+/*     CHUNKS                                                                */
+/*---------------------------------------------------------------------------*/
+
+static uint32_t table_crc[256];
+static pthread_once_t table_crc_prete = PTHREAD_ONCE_INIT;	/* rendus concurrents (daemon) */
+
+static void preparer_table_crc(void)
+{
+	for (uint32_t k = 0; k < 256; ++k) {
+		uint32_t c = k;
+		for (int b = 0; b < 8; ++b)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		table_crc[k] = c;
+	}
+}
+
+static uint32_t crc32_maj(uint32_t crc, const unsigned char *donnees, size_t n)
+{
+	pthread_once(&table_crc_prete, preparer_table_crc);
+
+	for (size_t k = 0; k < n; ++k)
+		crc = table_crc[(crc ^ donnees[k]) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+
+static void ecrire_32(struct ecrivain *e, uint32_t v)
+{
+	unsigned char octets[] = { v >> 24, (v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff };
+	e->ecrire(e, octets, sizeof (octets));
+}
+
+
+static void png_chunk(struct ecrivain *e, const char *type, const unsigned char *donnees, size_t n)
+{
+	uint32_t crc = crc32_maj(0xffffffffu, (const unsigned char *) type, 4);
+	crc = crc32_maj(crc, donnees, n) ^ 0xffffffffu;
+
+	ecrire_32(e, (uint32_t) n);
+	e->ecrire(e, type, 4);
+	if (n > 0)
+		e->ecrire(e, donnees, n);
+	ecrire_32(e, crc);
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     FLUX ZLIB EN BLOCS STOCKES                                            */
+/*---------------------------------------------------------------------------*/
+
+/* Le chunk IDAT en preparation : 2 octets reserves a l'en-tete zlib,
+ * 5 a l'en-tete du bloc stocke, puis les donnees du bloc. */
+#define PNG_DEBUT_BLOC 7
+
+static void png_emettre_bloc(struct sortie *s, int final)
+{
+	struct sortie_data *d = s->data;
+	unsigned char *bloc = d->chunk + PNG_DEBUT_BLOC;
+	size_t n = d->taille_bloc;
+
+	bloc[-5] = final ? 1 : 0;	// BFINAL, BTYPE = 00 (stocke)
+	bloc[-4] = n & 0xff;
+	bloc[-3] = (n >> 8) & 0xff;
+	bloc[-2] = ~n & 0xff;
+	bloc[-1] = (~n >> 8) & 0xff;
+
+	size_t fin = PNG_DEBUT_BLOC + n;
+	if (final) {
+		uint32_t adler = d->adler_b << 16 | d->adler_a;
+		d->chunk[fin++] = adler >> 24;
+		d->chunk[fin++] = (adler >> 16) & 0xff;
+		d->chunk[fin++] = (adler >> 8) & 0xff;
+		d->chunk[fin++] = adler & 0xff;
+	}
+
+	// Seul le premier IDAT porte l'en-tete zlib (deflate, fenetre 32 Ko)
+	size_t debut = 0;
+	if (d->premier_bloc) {
+		d->chunk[0] = 0x78;
+		d->chunk[1] = 0x01;
+		d->premier_bloc = 0;
+	} else {
+		debut = 2;
+	}
+
+	png_chunk(s->ecrivain, "IDAT", d->chunk + debut, fin - debut);
+	d->taille_bloc = 0;
+}
+
+
+static void png_flux(struct sortie *s, const unsigned char *donnees, size_t n)
+{
+	struct sortie_data *d = s->data;
+
+	while (n > 0) {
+		size_t k = PNG_TAILLE_BLOC - d->taille_bloc;
+		if (k > n)
+			k = n;
+
+		// Somme de controle Adler-32, reduite toutes les ADLER_NMAX octets
+		for (size_t i = 0; i < k; i += ADLER_NMAX) {
+			size_t fin = (i + ADLER_NMAX < k) ? i + ADLER_NMAX : k;
+			for (size_t j = i; j < fin; ++j) {
+				d->adler_a += donnees[j];
+				d->adler_b += d->adler_a;
+			}
+			d->adler_a %= ADLER_MOD;
+			d->adler_b %= ADLER_MOD;
+		}
+
+		memcpy(d->chunk + PNG_DEBUT_BLOC + d->taille_bloc, donnees, k);
+		d->taille_bloc += k;
+		donnees += k;
+		n -= k;
+
+		if (d->taille_bloc == PNG_TAILLE_BLOC)
+			png_emettre_bloc(s, 0);
+	}
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     SORTIE PNG                                                            */
+/*---------------------------------------------------------------------------*/
+
+static void png_ecrire_ligne(struct sortie *s, const unsigned char *ligne)
+{
+	struct sortie_data *d = s->data;
+
+	d->ligne[0] = 0;	// Filtre "None"
+
+	if (!s->indexee || d->profondeur == 8) {
+		memcpy(d->ligne + 1, ligne, d->taille_ligne - 1);
+	} else {
+		// Indices tasses, pixel de gauche dans les bits de poids fort
+		int par_octet = 8 / d->profondeur;
+		memset(d->ligne + 1, 0, d->taille_ligne - 1);
+
+		for (unsigned int x = 0; x < s->largeur; ++x) {
+			int decalage = 8 - d->profondeur * (x % par_octet + 1);
+			d->ligne[1 + x / par_octet] |= ligne[x] << decalage;
+		}
+	}
+
+	png_flux(s, d->ligne, d->taille_ligne);
+}
+
+
+static void png_terminer(struct sortie *s)
+{
+	png_emettre_bloc(s, 1);
+	png_chunk(s->ecrivain, "IEND", NULL, 0);
+
+	if (s->data != NULL) {
+		free(s->data->ligne);
+		free(s->data->chunk);
+		free(s->data);
+	}
+}
+
+
+static unsigned char *png_tampon_ligne(struct sortie *s)
+{
+	(void) s;
+	return NULL;
+}
+
+
+struct sortie *creer_sortie_png(struct ecrivain *e, unsigned int hauteur, unsigned int largeur,
+                                const struct palette *pal)
+{
+	static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	struct sortie *s = malloc(sizeof (struct sortie));
+	struct sortie_data *d = calloc(1, sizeof (struct sortie_data));
+
+	if (s == NULL || d == NULL) {
+		free(s);
+		free(d);
+		return NULL;
+	}
+
+	// Profondeur minimale selon le nombre de couleurs de la palette
+	int indexee = (pal != NULL && !pal->pleine && pal->nb_couleurs > 0);
+	if (indexee) {
+		d->profondeur = (pal->nb_couleurs <= 2) ? 1
+		              : (pal->nb_couleurs <= 4) ? 2
+		              : (pal->nb_couleurs <= 16) ? 4 : 8;
+		d->taille_ligne = 1 + ((size_t) largeur * d->profondeur + 7) / 8;
+	} else {
+		d->profondeur = 8;
+		d->taille_ligne = 1 + 3 * (size_t) largeur;
+	}
+
+	d->ligne = malloc(d->taille_ligne);
+	d->chunk = malloc(PNG_DEBUT_BLOC + PNG_TAILLE_BLOC + 4);
+	if (d->ligne == NULL || d->chunk == NULL) {
+		free(d->ligne);
+		free(d->chunk);
+		free(d);
+		free(s);
+		return NULL;
+	}
+
+	d->premier_bloc = 1;
+	d->adler_a = 1;
+
+	// Initialisation du contenu de la sortie et branchements
+	s->data = d;
+	s->ecrivain = e;
+	s->hauteur = hauteur;
+	s->largeur = largeur;
+	s->indexee = indexee;
+	s->ecrire_ligne = &png_ecrire_ligne;
+	s->tampon_ligne = &png_tampon_ligne;
+	s->terminer = &png_terminer;
+
+	// Signature, en-tête IHDR et palette PLTE
+	unsigned char ihdr[13] = {
+		largeur >> 24, (largeur >> 16) & 0xff, (largeur >> 8) & 0xff, largeur & 0xff,
+		hauteur >> 24, (hauteur >> 16) & 0xff, (hauteur >> 8) & 0xff, hauteur & 0xff,
+		d->profondeur, indexee ? 3 : 2, 0, 0, 0
+	};
+
+	e->ecrire(e, signature, sizeof (signature));
+	png_chunk(e, "IHDR", ihdr, sizeof (ihdr));
+	if (indexee)
+		png_chunk(e, "PLTE", &pal->rvb[0][0], 3 * (size_t) pal->nb_couleurs);
+
+	return s;
+}
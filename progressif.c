@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L	/* pwrite, clock_gettime */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "progressif.h"
+#include "image.h"
+#include "stats.h"
+
+
+/* Ecriture complete de n octets a la position donnee du fichier. */
+static int ecrire_a(int fd, const unsigned char *octets, size_t n, off_t position)
+{
+	stats.octets_ecrits += n;
+	while (n > 0) {
+		ssize_t k = pwrite(fd, octets, n, position);
+		if (k < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		octets += k;
+		position += k;
+		n -= (size_t) k;
+	}
+
+	return 0;
+}
+
+
+static double millisecondes(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     APERCU                                                                */
+/*---------------------------------------------------------------------------*/
+
+/* Couleur moyenne de chaque tuile. */
+static void couleurs_moyennes(unsigned char moyennes[NB_NAT_PRIMITIFS][NB_ORIENTATIONS][3],
+                              const struct tuiles *tuiles)
+{
+	const size_t nb_pixels = (size_t) tuiles->cote * tuiles->cote;
+
+	for (int nat = 0; nat < NB_NAT_PRIMITIFS; ++nat) {
+		for (int or = 0; or < NB_ORIENTATIONS; ++or) {
+			const unsigned char *pixel = tuiles->rvb[nat][or];
+			uint64_t somme[3] = { 0, 0, 0 };
+
+			for (size_t p = 0; p < nb_pixels; ++p, pixel += 3) {
+				somme[0] += pixel[0];
+				somme[1] += pixel[1];
+				somme[2] += pixel[2];
+			}
+
+			for (int c = 0; c < 3; ++c)
+				moyennes[nat][or][c] = (unsigned char) ((somme[c] + nb_pixels / 2) / nb_pixels);
+		}
+	}
+}
+
+
+/* Ligne de pixels de l'apercu de la ligne de primitifs prims : cote pixels
+ * de la couleur moyenne de chaque primitif. */
+static void ligne_apercu(unsigned char *ligne, const struct primitif *prims, uint16_t largeur,
+                         unsigned char moyennes[NB_NAT_PRIMITIFS][NB_ORIENTATIONS][3],
+                         unsigned int cote)
+{
+	for (uint16_t j = 0; j < largeur; ++j) {
+		unsigned char *cellule = ligne + (size_t) j * cote * 3;
+		memcpy(cellule, moyennes[prims[j].nature][prims[j].orientation], 3);
+
+		// Le premier pixel est recopie en doublant la zone deja ecrite
+		for (size_t ecrits = 3; ecrits < (size_t) cote * 3; ecrits *= 2) {
+			size_t n = (ecrits * 2 <= (size_t) cote * 3) ? ecrits : (size_t) cote * 3 - ecrits;
+			memcpy(cellule + ecrits, cellule, n);
+		}
+	}
+}
+
+
+/* Ecriture de la miniature (un pixel par primitif, de sa couleur moyenne)
+ * dans chemin, a cote puis renommee. Retourne 0, ou -1. */
+static int ecrire_miniature(const char *chemin, const struct patchwork *patch,
+                            unsigned char moyennes[NB_NAT_PRIMITIFS][NB_ORIENTATIONS][3])
+{
+	char temporaire[4096 + sizeof (".tmp")];
+	snprintf(temporaire, sizeof (temporaire), "%s.tmp", chemin);
+
+	int fd = open(temporaire, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return -1;
+
+	char entete[64];
+	int taille_entete = snprintf(entete, sizeof (entete), "P6\n%u %u\n255\n",
+								 (unsigned int) patch->largeur, (unsigned int) patch->hauteur);
+
+	unsigned char *ligne = malloc((size_t) patch->largeur * 3);
+	int ok = (ligne != NULL
+			  && ecrire_a(fd, (const unsigned char *) entete, (size_t) taille_entete, 0) == 0);
+
+	for (uint16_t i = 0; ok && i < patch->hauteur; ++i) {
+		ligne_apercu(ligne, patch->primitifs[i], patch->largeur, moyennes, 1);
+		ok = (ecrire_a(fd, ligne, (size_t) patch->largeur * 3,
+					   taille_entete + (off_t) i * patch->largeur * 3) == 0);
+	}
+	free(ligne);
+
+	if (close(fd) != 0 || !ok || rename(temporaire, chemin) != 0) {
+		unlink(temporaire);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     FICHIER DE PROGRESSION                                                */
+/*---------------------------------------------------------------------------*/
+
+/* Creation du fichier de progression, toutes les bandes a l'etat d'apercu :
+ * ecrit a cote puis renomme, une visionneuse ne le voit jamais incomplet.
+ * Retourne son descripteur et la position de la marque de la premiere
+ * bande, ou -1. */
+static int creer_progression(const char *chemin, size_t largeur, size_t hauteur,
+                             uint16_t bandes, unsigned int cote, off_t *marques)
+{
+	char temporaire[4096 + sizeof (".tmp")];
+	snprintf(temporaire, sizeof (temporaire), "%s.tmp", chemin);
+
+	int fd = open(temporaire, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return -1;
+
+	char entete[96];
+	int taille_entete = snprintf(entete, sizeof (entete), "patchwork-progression %zu %zu %u %u\n",
+								 largeur, hauteur, (unsigned int) bandes, cote);
+
+	unsigned char *etats = malloc((size_t) bandes + 1);
+	int ok = (etats != NULL);
+	if (ok) {
+		memset(etats, '.', bandes);
+		etats[bandes] = '\n';
+		ok = (ecrire_a(fd, (const unsigned char *) entete, (size_t) taille_entete, 0) == 0
+			  && ecrire_a(fd, etats, (size_t) bandes + 1, taille_entete) == 0
+			  && rename(temporaire, chemin) == 0);
+	}
+	free(etats);
+
+	if (!ok) {
+		close(fd);
+		unlink(temporaire);
+		return -1;
+	}
+
+	*marques = taille_entete;
+	return fd;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     RENDU PROGRESSIF                                                      */
+/*---------------------------------------------------------------------------*/
+
+/* Ordre d'affinage des bandes : du centre vers les bords, en alternant
+ * au-dessus et au-dessous. */
+static void ordre_bandes(uint16_t *ordre, uint16_t bandes)
+{
+	uint16_t centre = bandes / 2, k = 0;
+	ordre[k++] = centre;
+
+	for (uint16_t d = 1; k < bandes; ++d) {
+		if (d <= centre)
+			ordre[k++] = centre - d;
+		if ((uint32_t) centre + d < bandes)
+			ordre[k++] = centre + d;
+	}
+}
+
+
+int rendre_progressif(const struct patchwork *patch, const char *sortie,
+                      const struct tuiles *tuiles)
+{
+	if (patch == NULL) {
+		fprintf(stderr, "ERREUR. L'expression en entrée est incorrecte.\n");
+		return -1;
+	}
+
+	const unsigned int cote = tuiles->cote;
+	const size_t largeur_image = (size_t) cote * patch->largeur;
+	const size_t hauteur_image = (size_t) cote * patch->hauteur;
+	const size_t octets_ligne = largeur_image * 3;
+	double debut = millisecondes();
+
+	char chemin_progression[4096], chemin_miniature[4096];
+	snprintf(chemin_progression, sizeof (chemin_progression), "%s%s", sortie, SUFFIXE_PROGRESSION);
+	snprintf(chemin_miniature, sizeof (chemin_miniature), "%s%s", sortie, SUFFIXE_MINIATURE);
+	unlink(chemin_progression);	// celui d'un rendu precedent ne vaut plus
+
+	// ETAPE 0. Miniature : quelques octets par primitif, disponible aussitot
+	unsigned char moyennes[NB_NAT_PRIMITIFS][NB_ORIENTATIONS][3];
+	couleurs_moyennes(moyennes, tuiles);
+
+	if (ecrire_miniature(chemin_miniature, patch, moyennes) != 0) {
+		fprintf(stderr, "ERREUR. Écriture impossible : %s.\n", chemin_miniature);
+		return -1;
+	}
+
+	printf(":: Patchwork :: Miniature : %s (%.1f ms).\n", chemin_miniature,
+		   millisecondes() - debut);
+	fflush(stdout);
+
+	int fd = open(sortie, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", sortie);
+		return -1;
+	}
+
+	char entete[64];
+	int taille_entete = snprintf(entete, sizeof (entete), "P6\n%zu %zu\n255\n",
+								 largeur_image, hauteur_image);
+
+	unsigned char *ligne = malloc(octets_ligne);
+	uint16_t *ordre = malloc(patch->hauteur * sizeof (uint16_t));
+	int ok = (ligne != NULL && ordre != NULL
+			  && ecrire_a(fd, (const unsigned char *) entete, (size_t) taille_entete, 0) == 0);
+
+	// ETAPE 1. Apercu : chaque ligne de primitifs donne une ligne de pixels,
+	// ecrite cote fois
+	for (uint16_t i = 0; ok && i < patch->hauteur; ++i) {
+		ligne_apercu(ligne, patch->primitifs[i], patch->largeur, moyennes, cote);
+		for (unsigned int r = 0; ok && r < cote; ++r) {
+			off_t position = taille_entete + (off_t) ((size_t) i * cote + r) * octets_ligne;
+			ok = (ecrire_a(fd, ligne, octets_ligne, position) == 0);
+		}
+	}
+
+	off_t marques = 0;
+	int fd_progression = -1;
+	if (ok) {
+		fd_progression = creer_progression(chemin_progression, largeur_image, hauteur_image,
+										   patch->hauteur, cote, &marques);
+		ok = (fd_progression >= 0);
+	}
+
+	if (ok) {
+		printf(":: Patchwork :: Aperçu écrit en %.1f ms, affinage de %u bande(s).\n",
+			   millisecondes() - debut, (unsigned int) patch->hauteur);
+		fflush(stdout);
+	}
+
+	// ETAPE 2. Affinage : chaque bande est rendue en pleine resolution puis
+	// marquee comme definitive
+	if (ok)
+		ordre_bandes(ordre, patch->hauteur);
+
+	for (uint16_t k = 0; ok && k < patch->hauteur; ++k) {
+		uint16_t i = ordre[k];
+		for (unsigned int r = 0; ok && r < cote; ++r) {
+			off_t position = taille_entete + (off_t) ((size_t) i * cote + r) * octets_ligne;
+			image_ligne_rvb(ligne, patch->primitifs[i], patch->largeur, tuiles, r);
+			ok = (ecrire_a(fd, ligne, octets_ligne, position) == 0);
+		}
+
+		const unsigned char definitive = '#';
+		ok = ok && (ecrire_a(fd_progression, &definitive, 1, marques + i) == 0);
+	}
+
+	free(ligne);
+	free(ordre);
+	if (fd_progression >= 0 && close(fd_progression) != 0)
+		ok = 0;
+	if (close(fd) != 0)
+		ok = 0;
+
+	if (!ok) {
+		fprintf(stderr, "ERREUR. Écriture impossible : %s.\n", sortie);
+		return -1;
+	}
+
+	printf(":: Patchwork :: Résultat : %s (affiné en %.1f ms).\n", sortie,
+		   millisecondes() - debut);
+	return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef PROGRESSIF_H
+#define PROGRESSIF_H
+
+#include "patchwork.h"
+#include "tuiles.h"
+
+/* Suffixes de la miniature et du fichier de progression, ajoutes au
+ * chemin de l'image */
+#define SUFFIXE_MINIATURE ".apercu.ppm"
+#define SUFFIXE_PROGRESSION ".progression"
+
+/* Rendu progressif du patchwork patch dans le fichier PPM/P6 sortie, avec
+ * les tuiles donnees. Une miniature, un pixel par primitif de la couleur
+ * moyenne de sa tuile, est d'abord ecrite dans sortie.apercu.ppm : elle est
+ * disponible en quelques millisecondes, quelle que soit la taille finale.
+ * Puis l'apercu est ecrit en entier dans sortie : la miniature agrandie,
+ * chaque primitif etant un carre uni. Les bandes (une ligne de
+ * primitifs, soit cote lignes de pixels) sont ensuite rendues en pleine
+ * resolution et reecrites sur place, du centre de l'image vers ses bords.
+ *
+ * Le fichier sortie.progression apparait une fois l'apercu ecrit ; il
+ * indique l'avancement aux visionneuses :
+ *     patchwork-progression <largeur> <hauteur> <bandes> <pixels par bande>
+ *     <un caractere par bande, de haut en bas : '.' apercu, '#' definitive>
+ * L'image est complete lorsque la seconde ligne ne contient plus de '.'.
+ * Retourne 0, ou -1 en cas d'erreur (apres affichage d'un message). */
+extern int rendre_progressif(const struct patchwork *patch, const char *sortie,
+                             const struct tuiles *tuiles);
+
+#endif /* PROGRESSIF_H */
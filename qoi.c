@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sortie.h"
+
+/* Encodeur en flux du format QOI ("Quite OK Image", cf. qoiformat.org).
+ *
+ * Les patchworks sont tres repetitifs : une ligne de pixels se repete
+ * souvent a l'identique sur plusieurs lignes (lignes d'une meme tuile
+ * uniforme, lignes de primitifs identiques). Chaque ligne est donc encodee
+ * independamment (toute plage QOI_OP_RUN est close en fin de ligne), et
+ * le code d'une ligne repetee est reutilise tel quel : encoder une ligne L
+ * a partir de l'etat laisse par L lui-meme (dernier pixel et table d'index)
+ * redonne exactement les memes octets et le meme etat. */
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+
+#define QOI_RUN_MAX 62
+#define QOI_TAILLE_INDEX 64
+
+struct qoi_pixel {
+	unsigned char r, v, b, a;
+};
+
+struct sortie_data {
+	struct qoi_pixel precedent;
+	struct qoi_pixel index[QOI_TAILLE_INDEX];
+
+	unsigned char *ligne_prec;	/* derniere ligne encodee (RVB) */
+	unsigned char *code;		/* code QOI de la derniere ligne */
+	size_t taille_code;
+	int stable;			/* le code de ligne_prec est reutilisable */
+	unsigned int nb_lignes;
+};
+
+
+static int qoi_hash(struct qoi_pixel p)
+{
+	return (p.r * 3 + p.v * 5 + p.b * 7 + p.a * 11) % QOI_TAILLE_INDEX;
+}
+
+
+static int qoi_egaux(struct qoi_pixel p, struct qoi_pixel q)
+{
+	return p.r == q.r && p.v == q.v && p.b == q.b && p.a == q.a;
+}
+
+
+static void ecrire_32(struct ecrivain *e, unsigned int v)
+{
+	unsigned char octets[] = { v >> 24, (v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff };
+	e->ecrire(e, octets, sizeof (octets));
+}
+
+
+/* Encodage d'une ligne de l pixels dans code, a partir de l'etat courant.
+ * Renvoie : le nombre d'octets produits. */
+static size_t qoi_encoder_ligne(struct sortie_data *d, const unsigned char *ligne,
+                                unsigned int l, unsigned char *code)
+{
+	size_t n = 0;
+	unsigned int plage = 0;
+
+	for (unsigned int x = 0; x < l; ++x) {
+		struct qoi_pixel p = { ligne[3 * x], ligne[3 * x + 1], ligne[3 * x + 2], 255 };
+
+		if (qoi_egaux(p, d->precedent)) {
+			if (++plage == QOI_RUN_MAX) {
+				code[n++] = QOI_OP_RUN | (plage - 1);
+				plage = 0;
+			}
+			continue;
+		}
+
+		if (plage > 0) {
+			code[n++] = QOI_OP_RUN | (plage - 1);
+			plage = 0;
+		}
+
+		int h = qoi_hash(p);
+		if (qoi_egaux(d->index[h], p)) {
+			code[n++] = QOI_OP_INDEX | h;
+		} else {
+			d->index[h] = p;
+
+			signed char vr = p.r - d->precedent.r;
+			signed char vv = p.v - d->precedent.v;
+			signed char vb = p.b - d->precedent.b;
+			signed char vv_r = vr - vv;
+			signed char vv_b = vb - vv;
+
+			if (vr > -3 && vr < 2 && vv > -3 && vv < 2 && vb > -3 && vb < 2) {
+				code[n++] = QOI_OP_DIFF | (vr + 2) << 4 | (vv + 2) << 2 | (vb + 2);
+			} else if (vv_r > -9 && vv_r < 8 && vv > -33 && vv < 32 && vv_b > -9 && vv_b < 8) {
+				code[n++] = QOI_OP_LUMA | (vv + 32);
+				code[n++] = (vv_r + 8) << 4 | (vv_b + 8);
+			} else {
+				code[n++] = QOI_OP_RGB;
+				code[n++] = p.r;
+				code[n++] = p.v;
+				code[n++] = p.b;
+			}
+		}
+
+		d->precedent = p;
+	}
+
+	// La plage est close en fin de ligne : chaque ligne a un code autonome
+	if (plage > 0)
+		code[n++] = QOI_OP_RUN | (plage - 1);
+
+	return n;
+}
+
+
+static void qoi_ecrire_ligne(struct sortie *s, const unsigned char *ligne)
+{
+	struct sortie_data *d = s->data;
+	size_t taille_ligne = 3 * (size_t) s->largeur;
+
+	if (d->nb_lignes > 0 && memcmp(ligne, d->ligne_prec, taille_ligne) == 0) {
+		// Ligne repetee : une fois le code stable, il est simplement recopie
+		if (!d->stable) {
+			d->taille_code = qoi_encoder_ligne(d, ligne, s->largeur, d->code);
+			d->stable = 1;
+		}
+	} else {
+		d->taille_code = qoi_encoder_ligne(d, ligne, s->largeur, d->code);
+		d->stable = 0;
+		memcpy(d->ligne_prec, ligne, taille_ligne);
+	}
+
+	s->ecrivain->ecrire(s->ecrivain, d->code, d->taille_code);
+	d->nb_lignes++;
+}
+
+
+static void qoi_terminer(struct sortie *s)
+{
+	static const unsigned char fin[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+	s->ecrivain->ecrire(s->ecrivain, fin, sizeof (fin));
+
+	if (s->data != NULL) {
+		free(s->data->ligne_prec);
+		free(s->data->code);
+		free(s->data);
+	}
+}
+
+
+static unsigned char *qoi_tampon_ligne(struct sortie *s)
+{
+	(void) s;
+	return NULL;
+}
+
+
+struct sortie *creer_sortie_qoi(struct ecrivain *e, unsigned int hauteur, unsigned int largeur)
+{
+	struct sortie *s = malloc(sizeof (struct sortie));
+	struct sortie_data *d = calloc(1, sizeof (struct sortie_data));
+
+	if (s == NULL || d == NULL) {
+		free(s);
+		free(d);
+		return NULL;
+	}
+
+	// Au pire 4 octets par pixel (QOI_OP_RGB), plus la plage de fin de ligne
+	d->ligne_prec = malloc(3 * (size_t) largeur + 1);
+	d->code = malloc(4 * (size_t) largeur + 1);
+	if (d->ligne_prec == NULL || d->code == NULL) {
+		free(d->ligne_prec);
+		free(d->code);
+		free(d);
+		free(s);
+		return NULL;
+	}
+
+	d->precedent.a = 255;
+
+	// Initialisation du contenu de la sortie et branchements
+	s->data = d;
+	s->ecrivain = e;
+	s->hauteur = hauteur;
+	s->largeur = largeur;
+	s->indexee = 0;
+	s->ecrire_ligne = &qoi_ecrire_ligne;
+	s->tampon_ligne = &qoi_tampon_ligne;
+	s->terminer = &qoi_terminer;
+
+	// En-tête QOI : largeur et hauteur (gros-boutistes), 3 canaux, sRGB
+	static const unsigned char canaux[] = { 3, 0 };
+	e->ecrire(e, "qoif", 4);
+	ecrire_32(e, largeur);
+	ecrire_32(e, hauteur);
+	e->ecrire(e, canaux, sizeof (canaux));
+
+	return s;
+}
@@ -0,0 +1,469 @@
+#include <string.h>
+#include "quadtree.h"
+#include "stats.h"
+
+/* Niveaux des noeuds : un patchwork a au plus 65535 primitifs de cote */
+#define NB_NIVEAUX 17
+
+/* Valeur d'une feuille : nature << 2 | orientation, ou VIDE (hors de la
+ * fenetre d'un patchwork) ; INTERNE pour les noeuds decoupes. */
+#define NB_CELLULES (NB_NAT_PRIMITIFS * NB_ORIENTATIONS + 1)
+#define VIDE (NB_CELLULES - 1)
+#define INTERNE 0xff
+
+/* Noeuds alloues par bloc, et entrees du memo des extractions */
+#define NOEUDS_PAR_BLOC 4096
+#define TAILLE_MEMO (1 << 16)
+
+/* Indices des quarts d'un noeud interne */
+enum quart { NO, NE, SO, SE };
+
+struct noeud_qt {
+	struct noeud_qt *fils[4];	/* noeud interne : NO, NE, SO, SE */
+	struct noeud_qt *rotation;	/* rotation deja calculee, ou NULL */
+	struct noeud_qt *suivant;	/* chainage dans la table d'unicite */
+	uint8_t niveau;			/* cote de 2^niveau primitifs */
+	uint8_t cellule;		/* feuille : valeur ; sinon INTERNE */
+};
+
+struct bloc_noeuds {
+	struct bloc_noeuds *suivant;
+	size_t utilises;
+	struct noeud_qt noeuds[NOEUDS_PAR_BLOC];
+};
+
+/* Extraction deja calculee (cf. extraire) ; le memo est a correspondance
+ * directe, une entree en remplace une autre en cas de collision. */
+struct memo_extraction {
+	const struct noeud_qt *n;
+	int32_t y, x;
+	uint8_t niveau;
+	struct noeud_qt *resultat;
+};
+
+/* Foret de tous les noeuds du module */
+static struct {
+	struct noeud_qt **alveoles;	/* table d'unicite des noeuds internes */
+	size_t nb_alveoles;
+	size_t nb_noeuds;
+	struct bloc_noeuds *blocs;
+	struct noeud_qt *feuilles[NB_NIVEAUX][NB_CELLULES];
+	struct memo_extraction *memo;
+} foret;
+
+
+/*---------------------------------------------------------------------------*/
+/*     FORET ET NOEUDS UNIQUES                                               */
+/*---------------------------------------------------------------------------*/
+
+/* Allocation de la foret a la premiere utilisation. Retourne 0, ou -1 si
+ * la memoire manque. */
+static int preparer_foret(void)
+{
+	if (foret.alveoles != NULL)
+		return 0;
+
+	foret.nb_alveoles = 1024;
+	foret.alveoles = calloc(foret.nb_alveoles, sizeof (struct noeud_qt *));
+	foret.memo = calloc(TAILLE_MEMO, sizeof (struct memo_extraction));
+	if (foret.alveoles == NULL || foret.memo == NULL) {
+		free(foret.alveoles);
+		free(foret.memo);
+		foret.alveoles = NULL;
+		foret.memo = NULL;
+		return -1;
+	}
+
+	stats_allocation(foret.nb_alveoles * sizeof (struct noeud_qt *)
+	                 + TAILLE_MEMO * sizeof (struct memo_extraction));
+	return 0;
+}
+
+
+/* Les blocs de noeuds comptent dans la memoire des patchworks. */
+static void compter_bloc(long long octets)
+{
+	stats.memoire_patchworks += octets;
+	if (stats.memoire_patchworks > stats.memoire_patchworks_max)
+		stats.memoire_patchworks_max = stats.memoire_patchworks;
+}
+
+
+static struct noeud_qt *allouer_noeud(void)
+{
+	struct bloc_noeuds *b = foret.blocs;
+	if (b == NULL || b->utilises == NOEUDS_PAR_BLOC) {
+		b = malloc(sizeof (struct bloc_noeuds));
+		if (b == NULL)
+			return NULL;
+
+		b->suivant = foret.blocs;
+		b->utilises = 0;
+		foret.blocs = b;
+		stats_allocation(sizeof (struct bloc_noeuds));
+		compter_bloc(sizeof (struct bloc_noeuds));
+	}
+
+	stats.quadtree_noeuds++;
+	return &b->noeuds[b->utilises++];
+}
+
+
+/* Feuille uniforme de niveau et de valeur donnes (unique). */
+static struct noeud_qt *feuille(uint8_t niveau, uint8_t cellule)
+{
+	struct noeud_qt *f = foret.feuilles[niveau][cellule];
+	if (f != NULL || (f = allouer_noeud()) == NULL)
+		return f;
+
+	memset(f, 0, sizeof (struct noeud_qt));
+	f->niveau = niveau;
+	f->cellule = cellule;
+	foret.feuilles[niveau][cellule] = f;
+	return f;
+}
+
+
+static size_t alveole(const struct noeud_qt *const fils[4], size_t nb_alveoles)
+{
+	uint64_t h = 0;
+	for (int q = 0; q < 4; ++q) {
+		h = (h ^ (uint64_t) (uintptr_t) fils[q]) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	return (size_t) h & (nb_alveoles - 1);
+}
+
+
+/* Doublement de la table d'unicite (sans effet si la memoire manque). */
+static void agrandir_table(void)
+{
+	size_t nb = 2 * foret.nb_alveoles;
+	struct noeud_qt **alveoles = calloc(nb, sizeof (struct noeud_qt *));
+	if (alveoles == NULL)
+		return;
+
+	for (size_t a = 0; a < foret.nb_alveoles; ++a) {
+		struct noeud_qt *n = foret.alveoles[a];
+		while (n != NULL) {
+			struct noeud_qt *suivant = n->suivant;
+			size_t i = alveole((const struct noeud_qt *const *) n->fils, nb);
+			n->suivant = alveoles[i];
+			alveoles[i] = n;
+			n = suivant;
+		}
+	}
+
+	free(foret.alveoles);
+	foret.alveoles = alveoles;
+	foret.nb_alveoles = nb;
+	stats_allocation(nb * sizeof (struct noeud_qt *));
+}
+
+
+/* Noeud de niveau donne de quarts no, ne, so, se (de niveau - 1) : la
+ * feuille commune si les quatre sont la meme feuille, sinon le noeud
+ * unique de ces quarts. Retourne NULL si un quart est NULL (memoire
+ * insuffisante), ce qui propage l'echec aux appelants. */
+static struct noeud_qt *noeud(uint8_t niveau, struct noeud_qt *no, struct noeud_qt *ne,
+                              struct noeud_qt *so, struct noeud_qt *se)
+{
+	if (no == NULL || ne == NULL || so == NULL || se == NULL)
+		return NULL;
+
+	if (no == ne && no == so && no == se && no->cellule != INTERNE)
+		return feuille(niveau, no->cellule);
+
+	struct noeud_qt *fils[4] = { no, ne, so, se };
+	size_t i = alveole((const struct noeud_qt *const *) fils, foret.nb_alveoles);
+	for (struct noeud_qt *n = foret.alveoles[i]; n != NULL; n = n->suivant) {
+		if (memcmp(n->fils, fils, sizeof (fils)) == 0) {
+			stats.quadtree_partages++;
+			return n;
+		}
+	}
+
+	struct noeud_qt *n = allouer_noeud();
+	if (n == NULL)
+		return NULL;
+
+	memcpy(n->fils, fils, sizeof (fils));
+	n->rotation = NULL;
+	n->niveau = niveau;
+	n->cellule = INTERNE;
+	n->suivant = foret.alveoles[i];
+	foret.alveoles[i] = n;
+
+	if (++foret.nb_noeuds > foret.nb_alveoles)
+		agrandir_table();
+	return n;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     OPERATIONS SUR LES ARBRES                                             */
+/*---------------------------------------------------------------------------*/
+
+/* Rotation dans le sens direct du carre de racine n : le quart NO du
+ * resultat est l'ancien NE tourne, NE l'ancien SE, SO l'ancien NO et SE
+ * l'ancien SO. Memorisee dans le noeud. */
+static struct noeud_qt *tourner(struct noeud_qt *n)
+{
+	if (n->rotation != NULL)
+		return n->rotation;
+
+	struct noeud_qt *r;
+	if (n->cellule == VIDE)
+		r = n;
+	else if (n->cellule != INTERNE)
+		r = feuille(n->niveau, (uint8_t) ((n->cellule & ~3) | ((n->cellule + 1) % NB_ORIENTATIONS)));
+	else
+		r = noeud(n->niveau, tourner(n->fils[NE]), tourner(n->fils[SE]),
+		          tourner(n->fils[NO]), tourner(n->fils[SO]));
+
+	n->rotation = r;
+	return r;
+}
+
+
+/* Carre de niveau donne dont le primitif (i, j) est le primitif (y + i,
+ * x + j) du carre de racine n (vide hors de ce carre). Le resultat est un
+ * sous-arbre de n si la position est alignee sur ses quarts ; sinon il est
+ * reconstruit quart par quart, et memorise. */
+static struct noeud_qt *extraire(struct noeud_qt *n, int32_t y, int32_t x, uint8_t niveau)
+{
+	const int32_t cote = (int32_t) 1 << n->niveau, c = (int32_t) 1 << niveau;
+
+	// Hors du carre de n
+	if (y >= cote || x >= cote || y + c <= 0 || x + c <= 0)
+		return feuille(niveau, VIDE);
+
+	int dedans = (y >= 0 && x >= 0 && y + c <= cote && x + c <= cote);
+	if (n->cellule != INTERNE) {
+		if (dedans || n->cellule == VIDE)
+			return feuille(niveau, n->cellule);
+	} else if (y == 0 && x == 0 && niveau == n->niveau) {
+		return n;
+	} else if (dedans && niveau < n->niveau) {
+		// Contenu dans un seul quart de n ?
+		const int32_t moitie = cote / 2;
+		int bas = (y >= moitie), droite = (x >= moitie);
+		if (y + c <= moitie * (bas + 1) && x + c <= moitie * (droite + 1))
+			return extraire(n->fils[2 * bas + droite], y - bas * moitie, x - droite * moitie,
+			                niveau);
+	}
+
+	uint64_t h = ((uint64_t) (uintptr_t) n * 0x9e3779b97f4a7c15ULL)
+		^ ((uint64_t) (uint32_t) y << 32 | (uint32_t) x) ^ niveau;
+	h ^= h >> 31;
+	struct memo_extraction *m = &foret.memo[(h * 0xbf58476d1ce4e5b9ULL >> 48) & (TAILLE_MEMO - 1)];
+	if (m->n == n && m->y == y && m->x == x && m->niveau == niveau)
+		return m->resultat;
+
+	// niveau >= 1 : un carre de niveau 0 tient toujours dans un quart
+	const int32_t d = c / 2;
+	struct noeud_qt *res = noeud(niveau,
+	                             extraire(n, y, x, niveau - 1), extraire(n, y, x + d, niveau - 1),
+	                             extraire(n, y + d, x, niveau - 1), extraire(n, y + d, x + d, niveau - 1));
+
+	if (res != NULL) {
+		m->n = n;
+		m->y = y;
+		m->x = x;
+		m->niveau = niveau;
+		m->resultat = res;
+	}
+	return res;
+}
+
+
+/* Reunion de deux carres de meme niveau aux contenus disjoints (chaque
+ * primitif est vide dans l'un au moins). Seuls les noeuds a la frontiere
+ * des deux contenus sont reconstruits. */
+static struct noeud_qt *fusionner(struct noeud_qt *a, struct noeud_qt *b)
+{
+	if (a == NULL || b == NULL)
+		return NULL;
+	if (b->cellule == VIDE)
+		return a;
+	if (a->cellule == VIDE)
+		return b;
+	if (a->cellule != INTERNE || b->cellule != INTERNE)
+		return a;	// chevauchement : exclu par la precondition
+
+	return noeud(a->niveau, fusionner(a->fils[NO], b->fils[NO]), fusionner(a->fils[NE], b->fils[NE]),
+	             fusionner(a->fils[SO], b->fils[SO]), fusionner(a->fils[SE], b->fils[SE]));
+}
+
+
+/* Plus petit niveau dont le carre contient n primitifs de cote. */
+static uint8_t niveau_pour(uint32_t n)
+{
+	uint8_t niveau = 0;
+	while (((uint32_t) 1 << niveau) < n)
+		niveau++;
+	return niveau;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     PATCHWORKS                                                            */
+/*---------------------------------------------------------------------------*/
+
+static struct patchwork_qt *envelopper(const struct noeud_qt *racine, uint32_t h, uint32_t l,
+                                       int32_t y, int32_t x)
+{
+	if (racine == NULL)
+		return NULL;
+
+	struct patchwork_qt *pw = malloc(sizeof (struct patchwork_qt));
+	if (pw == NULL)
+		return NULL;
+
+	pw->hauteur = (uint16_t) h;
+	pw->largeur = (uint16_t) l;
+	pw->y = y;
+	pw->x = x;
+	pw->racine = racine;
+
+	stats.allocations++;
+	stats.octets_alloues += sizeof (struct patchwork_qt);
+	stats_patchwork(sizeof (struct patchwork_qt));
+	return pw;
+}
+
+
+// precond: nat ok, verifiee a la construction
+struct patchwork_qt *creer_primitif_qt(const enum nature_primitif nat)
+{
+	if (preparer_foret() != 0)
+		return NULL;
+
+	return envelopper(feuille(0, (uint8_t) (nat << 2 | EST)), 1, 1, 0, 0);
+}
+
+
+// precond: p valide
+struct patchwork_qt *creer_rotation_qt(const struct patchwork_qt *p)
+{
+	if (p == NULL)
+		return NULL;
+
+	// Le primitif (r, c) du carre passe en (cote - 1 - c, r)
+	int32_t cote = (int32_t) 1 << p->racine->niveau;
+	return envelopper(tourner((struct noeud_qt *) p->racine), p->largeur, p->hauteur,
+	                  cote - p->x - p->largeur, p->y);
+}
+
+
+// precond: p_g et p_d valides
+struct patchwork_qt *creer_juxtaposition_qt(const struct patchwork_qt *p_g,
+                                            const struct patchwork_qt *p_d)
+{
+	if (p_g == NULL
+		|| p_d == NULL
+		|| p_g->hauteur != p_d->hauteur	// Dimensions incompatibles !
+		|| (uint32_t) p_g->largeur + p_d->largeur > UINT16_MAX)
+		return NULL;
+
+	uint32_t h = p_g->hauteur, l = (uint32_t) p_g->largeur + p_d->largeur;
+	uint8_t niveau = niveau_pour(h > l ? h : l);
+
+	// Chaque operande est ramene a sa place dans le resultat (p_d decale
+	// de la largeur de p_g), puis les deux arbres sont fusionnes
+	struct noeud_qt *g = extraire((struct noeud_qt *) p_g->racine, p_g->y, p_g->x, niveau);
+	struct noeud_qt *d = extraire((struct noeud_qt *) p_d->racine, p_d->y,
+	                              p_d->x - p_g->largeur, niveau);
+	return envelopper(fusionner(g, d), h, l, 0, 0);
+}
+
+
+// precond: p_h et p_b valides
+struct patchwork_qt *creer_superposition_qt(const struct patchwork_qt *p_h,
+                                            const struct patchwork_qt *p_b)
+{
+	if (p_h == NULL
+		|| p_b == NULL
+		|| p_h->largeur != p_b->largeur	// Dimensions incompatibles !
+		|| (uint32_t) p_h->hauteur + p_b->hauteur > UINT16_MAX)
+		return NULL;
+
+	uint32_t h = (uint32_t) p_h->hauteur + p_b->hauteur, l = p_h->largeur;
+	uint8_t niveau = niveau_pour(h > l ? h : l);
+
+	struct noeud_qt *haut = extraire((struct noeud_qt *) p_h->racine, p_h->y, p_h->x, niveau);
+	struct noeud_qt *bas = extraire((struct noeud_qt *) p_b->racine, p_b->y - p_h->hauteur,
+	                                p_b->x, niveau);
+	return envelopper(fusionner(haut, bas), h, l, 0, 0);
+}
+
+
+/* Ajout a ligne des plages de la ligne y du carre de racine n (de coin
+ * superieur gauche (haut, gauche)), entre les colonnes debut et fin. */
+static void parcourir_ligne(const struct noeud_qt *n, int32_t haut, int32_t gauche, int32_t y,
+                            int32_t debut, int32_t fin, struct ligne_rle *ligne)
+{
+	const int32_t cote = (int32_t) 1 << n->niveau;
+	if (gauche >= fin || gauche + cote <= debut)
+		return;
+
+	if (n->cellule == INTERNE) {
+		const int32_t moitie = cote / 2;
+		int bas = (y >= haut + moitie);
+		parcourir_ligne(n->fils[2 * bas], haut + bas * moitie, gauche, y, debut, fin, ligne);
+		parcourir_ligne(n->fils[2 * bas + 1], haut + bas * moitie, gauche + moitie, y,
+		                debut, fin, ligne);
+		return;
+	}
+
+	// Feuille : une plage, prolongeant la precedente si meme primitif
+	int32_t c0 = (gauche > debut) ? gauche : debut;
+	int32_t c1 = (gauche + cote < fin) ? gauche + cote : fin;
+	struct primitif prim = { n->cellule >> 2, n->cellule & 3 };
+	struct plage *derniere = (ligne->nb > 0) ? &ligne->plages[ligne->nb - 1] : NULL;
+
+	if (derniere != NULL && derniere->primitif.nature == prim.nature
+		&& derniere->primitif.orientation == prim.orientation) {
+		derniere->longueur += (uint16_t) (c1 - c0);
+	} else {
+		ligne->plages[ligne->nb].longueur = (uint16_t) (c1 - c0);
+		ligne->plages[ligne->nb++].primitif = prim;
+	}
+}
+
+
+void ligne_qt(const struct patchwork_qt *p, uint16_t i, struct ligne_rle *ligne)
+{
+	ligne->nb = 0;
+	parcourir_ligne(p->racine, 0, 0, p->y + i, p->x, p->x + p->largeur, ligne);
+}
+
+
+void liberer_patchwork_qt(struct patchwork_qt *patch)
+{
+	if (patch != NULL) {
+		stats_patchwork(-(long long) sizeof (struct patchwork_qt));
+		free(patch);
+	}
+}
+
+
+uint64_t noeuds_qt(void)
+{
+	return foret.nb_noeuds;
+}
+
+
+void vider_quadtrees(void)
+{
+	while (foret.blocs != NULL) {
+		struct bloc_noeuds *suivant = foret.blocs->suivant;
+		compter_bloc(-(long long) sizeof (struct bloc_noeuds));
+		free(foret.blocs);
+		foret.blocs = suivant;
+	}
+
+	free(foret.alveoles);
+	free(foret.memo);
+	memset(&foret, 0, sizeof (foret));
+}
@@ -0,0 +1,64 @@
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include <stdint.h>
+#include "patchwork.h"
+#include "rle.h"
+
+/* Representation des patchworks par arbres quaternaires : un noeud de
+ * niveau k represente un carre de 2^k x 2^k primitifs, soit uniforme
+ * (feuille : un seul primitif, ou vide), soit decoupe en quatre quarts de
+ * niveau k - 1. Les noeuds sont uniques (hash-consing) : deux sous-arbres
+ * identiques sont un seul et meme noeud, et un carre uniforme est toujours
+ * une feuille. La memoire depend ainsi du nombre de sous-arbres distincts,
+ * et non de la surface.
+ *
+ * Les noeuds appartiennent a une foret commune au module, et ne sont
+ * liberes qu'ensemble (vider_quadtrees) ; le module n'est pas reentrant.
+ * Les fonctions suivent celles de patchwork.h. */
+
+struct noeud_qt;
+
+/* Un patchwork est la fenetre hauteur x largeur, de coin superieur gauche
+ * (y, x), du carre represente par racine (vide hors de la fenetre). */
+struct patchwork_qt {
+	uint16_t hauteur, largeur;
+	int32_t y, x;
+	const struct noeud_qt *racine;
+};
+
+/* Cree et retourne un patchwork d'une image primitive, de taille 1x1, de
+ * nature nat et d'orientation EST. */
+extern struct patchwork_qt *creer_primitif_qt(const enum nature_primitif nat);
+
+/* Rotation de 90 degres dans le sens direct : permutation des quarts de
+ * chaque noeud et decalage des orientations des feuilles, memorisee par
+ * noeud ; la fenetre est deplacee en consequence. */
+extern struct patchwork_qt *creer_rotation_qt(const struct patchwork_qt *p);
+
+/* Juxtaposition de p_g et p_d (p_g a gauche de p_d) : les deux arbres,
+ * ramenes a leur position dans le resultat, sont fusionnes.
+ * Si les tailles ne sont par concordantes, retourne NULL. */
+extern struct patchwork_qt *creer_juxtaposition_qt(const struct patchwork_qt *p_g,
+                                                   const struct patchwork_qt *p_d);
+
+/* Superposition de p_h et p_b (p_h au dessus de p_b), par fusion.
+ * Si les tailles ne sont par concordantes, retourne NULL. */
+extern struct patchwork_qt *creer_superposition_qt(const struct patchwork_qt *p_h,
+                                                   const struct patchwork_qt *p_b);
+
+/* Plages de la ligne i (0 <= i < hauteur) du patchwork p, obtenues en ne
+ * visitant que les feuilles traversees par la ligne. ligne->plages doit
+ * pouvoir contenir largeur plages. */
+extern void ligne_qt(const struct patchwork_qt *p, uint16_t i, struct ligne_rle *ligne);
+
+/* Libere le patchwork p (ses noeuds restent dans la foret). */
+extern void liberer_patchwork_qt(struct patchwork_qt *p);
+
+/* Nombre de noeuds distincts de la foret. */
+extern uint64_t noeuds_qt(void);
+
+/* Libere tous les noeuds : les patchworks existants deviennent invalides. */
+extern void vider_quadtrees(void);
+
+#endif /* QUADTREE_H */
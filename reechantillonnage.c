@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include "reechantillonnage.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Les poids d'interpolation sont en virgule fixe sur 8 bits :
+ * un poids de 256 selectionne entierement le second echantillon. */
+#define POIDS_UN 256
+
+
+/* Coordonnee source (en virgule fixe 8 bits) du centre du pixel x
+ * d'une ligne de cote pixels, pour une ligne source de taille pixels.
+ * Les centres des pixels sont alignes : (x + 0.5) * taille / cote - 0.5. */
+static long coordonnee_source(unsigned int x, unsigned int cote, unsigned int taille)
+{
+	return ((2 * (long) x + 1) * taille * POIDS_UN) / (2 * (long) cote) - POIDS_UN / 2;
+}
+
+
+/* Calcul, pour chaque pixel x destination, des deux pixels source encadrants
+ * (premier[x], premier[x] + 1 borne) et du poids du second. */
+static void preparer_interpolation(unsigned int cote, unsigned int taille,
+                                   unsigned int *premier, unsigned int *second,
+                                   unsigned int *poids)
+{
+	for (unsigned int x = 0; x < cote; ++x) {
+		long c = coordonnee_source(x, cote, taille);
+		if (c < 0)
+			c = 0;
+
+		premier[x] = c / POIDS_UN;
+		poids[x] = c % POIDS_UN;
+
+		if (premier[x] >= taille - 1) {
+			premier[x] = taille - 1;
+			poids[x] = 0;
+		}
+
+		second[x] = (poids[x] == 0) ? premier[x] : premier[x] + 1;
+	}
+}
+
+
+/* Noyau vectoriel : dst[k] = a[k] + (b[k] - a[k]) * poids / 256 sur n octets.
+ * C'est la seule operation arithmetique du noyau bilineaire : les deux passes
+ * (horizontale sur le motif transpose, puis verticale) s'y ramenent. */
+static void interpoler_lignes(unsigned char *dst, const unsigned char *a,
+                              const unsigned char *b, size_t n, unsigned int poids)
+{
+	size_t k = 0;
+
+	if (poids == 0) {
+		memcpy(dst, a, n);
+		return;
+	}
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i p_b = _mm_set1_epi16((short) poids);
+	const __m128i p_a = _mm_set1_epi16((short) (POIDS_UN - poids));
+	const __m128i arrondi = _mm_set1_epi16(POIDS_UN / 2);
+
+	for (; k + 16 <= n; k += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *) (a + k));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (b + k));
+
+		__m128i bas = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), p_a),
+		                            _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), p_b));
+		__m128i haut = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), p_a),
+		                             _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), p_b));
+
+		bas = _mm_srli_epi16(_mm_add_epi16(bas, arrondi), 8);
+		haut = _mm_srli_epi16(_mm_add_epi16(haut, arrondi), 8);
+
+		_mm_storeu_si128((__m128i *) (dst + k), _mm_packus_epi16(bas, haut));
+	}
+#endif
+
+	for (; k < n; ++k) {
+		dst[k] = (unsigned char) ((a[k] * (POIDS_UN - poids) + b[k] * poids
+		                           + POIDS_UN / 2) >> 8);
+	}
+}
+
+
+/* Transposition d'un bloc RVB de hauteur x largeur pixels. */
+static void transposer(unsigned char *dst, const unsigned char *src,
+                       unsigned int hauteur, unsigned int largeur)
+{
+	for (unsigned int i = 0; i < hauteur; ++i) {
+		for (unsigned int j = 0; j < largeur; ++j) {
+			memcpy(dst + 3 * ((size_t) j * hauteur + i),
+			       src + 3 * ((size_t) i * largeur + j), 3);
+		}
+	}
+}
+
+
+/* Noyaux : res est rempli, retourne 0, ou -1 si une allocation echoue.
+ *
+ * Le noyau au plus proche reste scalaire : il ne calcule rien, chaque
+ * pixel est un gather de 3 octets, sans equivalent en SSE2 (pas
+ * d'instruction de gather avant AVX2). Sa partie volumineuse, les lignes
+ * repetees d'un motif agrandi, est deja une copie de ligne entiere
+ * (memcpy, vectorise par la bibliotheque C). Les variantes essayees
+ * (plages d'un meme pixel source recopiees par memcpy en doublant, ou
+ * ecrites par mots de 4 octets) n'etaient pas plus rapides de 4 a 4000
+ * pixels de cote, et plus lentes sur les petites tailles. */
+static int reechantillonner_proche(const struct motif *m, unsigned int cote,
+                                   unsigned char *res)
+{
+	size_t octets_ligne = 3 * (size_t) cote;
+	unsigned int *colonnes = malloc(cote * sizeof (unsigned int));
+	unsigned int precedente = m->hauteur;
+	if (colonnes == NULL)
+		return -1;
+
+	for (unsigned int x = 0; x < cote; ++x)
+		colonnes[x] = (unsigned int) (((2 * (unsigned long) x + 1) * m->largeur) / (2 * (unsigned long) cote));
+
+	for (unsigned int y = 0; y < cote; ++y) {
+		unsigned int source = (unsigned int) (((2 * (unsigned long) y + 1) * m->hauteur) / (2 * (unsigned long) cote));
+		unsigned char *ligne = res + y * octets_ligne;
+
+		// Deux lignes destination issues de la meme ligne source sont identiques
+		if (source == precedente) {
+			memcpy(ligne, ligne - octets_ligne, octets_ligne);
+			continue;
+		}
+
+		for (unsigned int x = 0; x < cote; ++x) {
+			const struct motif_pixel *p = &m->pixels[source][colonnes[x]];
+			ligne[3 * x] = p->R;
+			ligne[3 * x + 1] = p->V;
+			ligne[3 * x + 2] = p->B;
+		}
+
+		precedente = source;
+	}
+
+	free(colonnes);
+	return 0;
+}
+
+
+static int reechantillonner_bilineaire(const struct motif *m, unsigned int cote,
+                                       unsigned char *res)
+{
+	unsigned int h = m->hauteur, l = m->largeur;
+	unsigned char *source = malloc(3 * (size_t) h * l);
+	unsigned char *transpose = malloc(3 * (size_t) h * l);
+	unsigned char *colonnes = malloc(3 * (size_t) cote * h);
+	unsigned char *etape = malloc(3 * (size_t) h * cote);
+	unsigned int *premier = malloc(cote * sizeof (unsigned int));
+	unsigned int *second = malloc(cote * sizeof (unsigned int));
+	unsigned int *poids = malloc(cote * sizeof (unsigned int));
+	int ok = (source != NULL && transpose != NULL && colonnes != NULL && etape != NULL
+	          && premier != NULL && second != NULL && poids != NULL);
+
+	for (unsigned int i = 0; ok && i < h; ++i) {
+		for (unsigned int j = 0; j < l; ++j) {
+			unsigned char *p = source + 3 * ((size_t) i * l + j);
+			p[0] = m->pixels[i][j].R;
+			p[1] = m->pixels[i][j].V;
+			p[2] = m->pixels[i][j].B;
+		}
+	}
+
+	// Les passes n'ont lieu que si toutes les allocations ont reussi
+	if (ok) {
+		// Passe horizontale : sur le motif transpose, une colonne source est une
+		// ligne contigue de h pixels, interpolee d'un bloc.
+		transposer(transpose, source, h, l);
+		preparer_interpolation(cote, l, premier, second, poids);
+		for (unsigned int x = 0; x < cote; ++x) {
+			interpoler_lignes(colonnes + 3 * (size_t) x * h,
+			                  transpose + 3 * (size_t) premier[x] * h,
+			                  transpose + 3 * (size_t) second[x] * h,
+			                  3 * (size_t) h, poids[x]);
+		}
+		transposer(etape, colonnes, cote, h);
+
+		// Passe verticale : chaque ligne destination melange deux lignes
+		preparer_interpolation(cote, h, premier, second, poids);
+		for (unsigned int y = 0; y < cote; ++y) {
+			interpoler_lignes(res + 3 * (size_t) y * cote,
+			                  etape + 3 * (size_t) premier[y] * cote,
+			                  etape + 3 * (size_t) second[y] * cote,
+			                  3 * (size_t) cote, poids[y]);
+		}
+	}
+
+	free(source);
+	free(transpose);
+	free(colonnes);
+	free(etape);
+	free(premier);
+	free(second);
+	free(poids);
+	return ok ? 0 : -1;
+}
+
+
+unsigned char *reechantillonner(const struct motif *m, unsigned int cote,
+                                enum noyau_reechantillonnage noyau)
+{
+	if (m == NULL || m->pixels == NULL || m->hauteur == 0 || m->largeur == 0 || cote == 0)
+		return NULL;
+
+	unsigned char *res = malloc(3 * (size_t) cote * cote);
+	if (res == NULL)
+		return NULL;
+
+	int ok;
+	switch (noyau) {
+		case PLUS_PROCHE:
+			ok = (reechantillonner_proche(m, cote, res) == 0);
+			break;
+		case BILINEAIRE:
+			ok = (reechantillonner_bilineaire(m, cote, res) == 0);
+			break;
+		default:
+			ok = 0;
+	}
+
+	if (!ok) {
+		free(res);
+		return NULL;
+	}
+
+	return res;
+}
+
+
+enum noyau_reechantillonnage noyau_depuis_nom(const char *nom)
+{
+	static const char *noms_noyaux[NB_NOYAUX] = {
+		"proche",
+		"bilineaire"
+	};
+
+	for (int k = 0; k < NB_NOYAUX; ++k) {
+		if (strcmp(nom, noms_noyaux[k]) == 0)
+			return (enum noyau_reechantillonnage) k;
+	}
+
+	return NB_NOYAUX;
+}
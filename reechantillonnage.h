@@ -0,0 +1,25 @@
+#ifndef REECHANTILLONNAGE_H
+#define REECHANTILLONNAGE_H
+
+#include "motif.h"
+
+/* Noyaux de reechantillonnage des motifs */
+enum noyau_reechantillonnage {
+	PLUS_PROCHE,
+	BILINEAIRE,
+	NB_NOYAUX	/* sentinelle */
+};
+
+/* Cree et retourne un bloc RVB contigu de cote x cote pixels (soit
+ * cote * cote * 3 octets, ligne par ligne) obtenu en reechantillonnant
+ * le motif m avec le noyau donne.
+ * Retourne NULL si le motif est vide ou si une allocation echoue. */
+extern unsigned char *reechantillonner(const struct motif *m,
+                                       unsigned int cote,
+                                       enum noyau_reechantillonnage noyau);
+
+/* Retourne le noyau de nom nom ("proche" ou "bilineaire"),
+ * ou NB_NOYAUX si le nom est inconnu. */
+extern enum noyau_reechantillonnage noyau_depuis_nom(const char *nom);
+
+#endif /* REECHANTILLONNAGE_H */
@@ -0,0 +1,242 @@
+#include <string.h>
+#include "rle.h"
+#include "stats.h"
+
+
+/* Memoire occupee par un patchwork de h lignes et nb_plages plages. */
+static size_t taille_rle(uint16_t h, uint64_t nb_plages)
+{
+	return sizeof (struct patchwork_rle)
+		+ h * sizeof (struct ligne_rle)
+		+ (size_t) nb_plages * sizeof (struct plage);
+}
+
+
+/* Allocation d'un patchwork de h x l primitifs, aux lignes vides (a remplir
+ * avec remplir_ligne, puis a comptabiliser avec compter_rle). */
+static struct patchwork_rle *allouer_rle(uint16_t h, uint16_t l)
+{
+	struct patchwork_rle *pw = malloc(sizeof (struct patchwork_rle));
+	if (pw == NULL)
+		return NULL;
+
+	pw->hauteur = h;
+	pw->largeur = l;
+	pw->lignes = calloc(h, sizeof (struct ligne_rle));
+	if (pw->lignes == NULL) {
+		free(pw);
+		return NULL;
+	}
+
+	return pw;
+}
+
+
+/* Copie des nb plages dans la ligne. Retourne 0, ou -1 si la memoire manque. */
+static int remplir_ligne(struct ligne_rle *ligne, const struct plage *plages, uint16_t nb)
+{
+	ligne->plages = malloc(nb * sizeof (struct plage));
+	if (ligne->plages == NULL)
+		return -1;
+
+	memcpy(ligne->plages, plages, nb * sizeof (struct plage));
+	ligne->nb = nb;
+	stats.plages_copiees += nb;
+	return 0;
+}
+
+
+/* Comptabilisation d'un patchwork rempli. */
+static struct patchwork_rle *compter_rle(struct patchwork_rle *pw)
+{
+	stats.allocations += 2 + pw->hauteur;
+	stats.octets_alloues += taille_rle(pw->hauteur, plages_rle(pw));
+	stats_patchwork(taille_rle(pw->hauteur, plages_rle(pw)));
+	return pw;
+}
+
+
+/* Liberation d'un patchwork partiellement rempli (echec d'allocation). */
+static struct patchwork_rle *abandonner_rle(struct patchwork_rle *pw)
+{
+	for (uint16_t i = 0; i < pw->hauteur; ++i)
+		free(pw->lignes[i].plages);
+
+	free(pw->lignes);
+	free(pw);
+	return NULL;
+}
+
+
+static int meme_primitif(const struct primitif *a, const struct primitif *b)
+{
+	return a->nature == b->nature && a->orientation == b->orientation;
+}
+
+
+uint64_t plages_rle(const struct patchwork_rle *p)
+{
+	uint64_t nb = 0;
+	for (uint16_t i = 0; i < p->hauteur; ++i)
+		nb += p->lignes[i].nb;
+
+	return nb;
+}
+
+
+// precond: nat ok, verifiee a la construction
+struct patchwork_rle *creer_primitif_rle(const enum nature_primitif nat)
+{
+	struct patchwork_rle *pw = allouer_rle(1, 1);
+	struct plage plage = { 1, { nat, EST } };
+
+	if (pw == NULL || remplir_ligne(&pw->lignes[0], &plage, 1) != 0)
+		return (pw != NULL) ? abandonner_rle(pw) : NULL;
+
+	return compter_rle(pw);
+}
+
+
+// precond: p valide
+struct patchwork_rle *creer_rotation_rle(const struct patchwork_rle *p)
+{
+	if (p == NULL)
+		return NULL;
+
+	// Ligne i du resultat : colonne h - i - 1 de p, lue de haut en bas
+	uint16_t h = p->largeur;
+	uint16_t l = p->hauteur;
+	struct patchwork_rle *nouv_p = allouer_rle(h, l);
+
+	// debuts[c] : une plage de p commence a la colonne c (sur une ligne au moins)
+	unsigned char *debuts = calloc(h, 1);
+	struct plage *ligne = malloc(l * sizeof (struct plage));
+	uint16_t *curseurs = malloc(l * sizeof (uint16_t));	// plage de chaque ligne de p
+	uint16_t *positions = malloc(l * sizeof (uint16_t));	// et sa colonne de debut
+	int ok = (nouv_p != NULL && debuts != NULL && ligne != NULL
+	          && curseurs != NULL && positions != NULL);
+
+	for (uint16_t j = 0; ok && j < l; ++j) {
+		const struct ligne_rle *lj = &p->lignes[j];
+		uint16_t c = 0;
+		for (uint16_t k = 0; k < lj->nb; c += lj->plages[k++].longueur)
+			debuts[c] = 1;
+
+		curseurs[j] = lj->nb - 1;
+		positions[j] = h - lj->plages[lj->nb - 1].longueur;
+	}
+
+	uint16_t nb = 0;
+	for (uint16_t i = 0; ok && i < h; ++i) {
+		uint16_t c = h - i - 1;
+
+		// Aucune plage de p ne commence en c + 1 : meme ligne que la precedente
+		if (i == 0 || debuts[c + 1]) {
+			nb = 0;
+			for (uint16_t j = 0; j < l; ++j) {
+				while (positions[j] > c)
+					positions[j] -= p->lignes[j].plages[--curseurs[j]].longueur;
+
+				struct primitif prim = p->lignes[j].plages[curseurs[j]].primitif;
+				prim.orientation = (prim.orientation + 1) % NB_ORIENTATIONS;
+
+				if (nb > 0 && meme_primitif(&ligne[nb - 1].primitif, &prim)) {
+					ligne[nb - 1].longueur++;
+				} else {
+					ligne[nb].longueur = 1;
+					ligne[nb++].primitif = prim;
+				}
+			}
+		}
+
+		ok = (remplir_ligne(&nouv_p->lignes[i], ligne, nb) == 0);
+	}
+
+	free(debuts);
+	free(ligne);
+	free(curseurs);
+	free(positions);
+
+	if (!ok)
+		return (nouv_p != NULL) ? abandonner_rle(nouv_p) : NULL;
+	return compter_rle(nouv_p);
+}
+
+
+// precond: p_g et p_d valides
+struct patchwork_rle *creer_juxtaposition_rle(const struct patchwork_rle *p_g,
+                                              const struct patchwork_rle *p_d)
+{
+	if (p_g == NULL
+		|| p_d == NULL
+		|| p_g->hauteur != p_d->hauteur)	// Dimensions incompatibles !
+		return NULL;
+
+	if ((uint32_t) p_g->largeur + p_d->largeur > UINT16_MAX)	// Trop grand !
+		return NULL;
+
+	struct patchwork_rle *nouv_p = allouer_rle(p_g->hauteur, p_g->largeur + p_d->largeur);
+	if (nouv_p == NULL)
+		return NULL;
+
+	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
+		const struct ligne_rle *g = &p_g->lignes[i], *d = &p_d->lignes[i];
+		struct plage *dernier = &g->plages[g->nb - 1];
+		int fusion = meme_primitif(&dernier->primitif, &d->plages[0].primitif);
+		// Au plus une plage par primitif : nb tient dans la largeur
+		uint32_t nb = (uint32_t) g->nb + d->nb - fusion;
+
+		struct plage *plages = malloc(nb * sizeof (struct plage));
+		if (plages == NULL)
+			return abandonner_rle(nouv_p);
+
+		// Plages de gauche, puis de droite ; la plage a la jonction est
+		// fusionnee si elle porte le meme primitif des deux cotes
+		memcpy(plages, g->plages, g->nb * sizeof (struct plage));
+		memcpy(plages + g->nb, d->plages + fusion, (d->nb - fusion) * sizeof (struct plage));
+		if (fusion)
+			plages[g->nb - 1].longueur += d->plages[0].longueur;
+
+		nouv_p->lignes[i].nb = (uint16_t) nb;
+		nouv_p->lignes[i].plages = plages;
+		stats.plages_copiees += nb;
+	}
+
+	return compter_rle(nouv_p);
+}
+
+
+// precond: p_h et p_b valides
+struct patchwork_rle *creer_superposition_rle(const struct patchwork_rle *p_h,
+                                              const struct patchwork_rle *p_b)
+{
+	if (p_h == NULL
+		|| p_b == NULL
+		|| p_h->largeur != p_b->largeur)	// Dimensions incompatibles !
+		return NULL;
+
+	if ((uint32_t) p_h->hauteur + p_b->hauteur > UINT16_MAX)	// Trop grand !
+		return NULL;
+
+	struct patchwork_rle *nouv_p = allouer_rle(p_h->hauteur + p_b->hauteur, p_h->largeur);
+	if (nouv_p == NULL)
+		return NULL;
+
+	for (uint16_t i = 0; i < nouv_p->hauteur; ++i) {
+		const struct ligne_rle *source = (i < p_h->hauteur) ? &p_h->lignes[i]
+		                                                    : &p_b->lignes[i - p_h->hauteur];
+		if (remplir_ligne(&nouv_p->lignes[i], source->plages, source->nb) != 0)
+			return abandonner_rle(nouv_p);
+	}
+
+	return compter_rle(nouv_p);
+}
+
+
+void liberer_patchwork_rle(struct patchwork_rle *patch)
+{
+	if (patch != NULL) {
+		stats_patchwork(-(long long) taille_rle(patch->hauteur, plages_rle(patch)));
+		abandonner_rle(patch);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdint.h>
+#include "patchwork.h"
+
+/* Representation des patchworks par plages : chaque ligne est une suite de
+ * plages (longueur, primitif) de primitifs identiques consecutifs. Les
+ * operations travaillent sur les plages, leur cout (et la memoire occupee)
+ * depend du nombre de plages et non du nombre de primitifs.
+ * Les fonctions suivent celles de patchwork.h. */
+
+struct plage {
+	uint16_t longueur;		/* >= 1 */
+	struct primitif primitif;
+};
+
+struct ligne_rle {
+	uint16_t nb;			/* nombre de plages (>= 1) */
+	struct plage *plages;		/* de longueur totale largeur */
+};
+
+struct patchwork_rle {
+	uint16_t hauteur, largeur;
+	struct ligne_rle *lignes;	/* tableau de hauteur lignes */
+};
+
+/* Cree et retourne un patchwork d'une image primitive, de taille 1x1, de
+ * nature nat et d'orientation EST. */
+extern struct patchwork_rle *creer_primitif_rle(const enum nature_primitif nat);
+
+/* Rotation de 90 degres dans le sens direct : les colonnes de p deviennent
+ * les lignes du resultat. Une ligne n'est reconstruite qu'aux colonnes ou
+ * commence une plage de p ; ailleurs elle est la copie de la precedente. */
+extern struct patchwork_rle *creer_rotation_rle(const struct patchwork_rle *p);
+
+/* Juxtaposition de p_g et p_d (p_g a gauche de p_d) : concatenation des
+ * plages de chaque ligne, la derniere plage de p_g et la premiere de p_d
+ * etant fusionnees si elles portent le meme primitif.
+ * Si les tailles ne sont par concordantes, retourne NULL. */
+extern struct patchwork_rle *creer_juxtaposition_rle(const struct patchwork_rle *p_g,
+                                                     const struct patchwork_rle *p_d);
+
+/* Superposition de p_h et p_b (p_h au dessus de p_b) : concatenation des
+ * listes de lignes.
+ * Si les tailles ne sont par concordantes, retourne NULL. */
+extern struct patchwork_rle *creer_superposition_rle(const struct patchwork_rle *p_h,
+                                                     const struct patchwork_rle *p_b);
+
+/* Nombre total de plages du patchwork p. */
+extern uint64_t plages_rle(const struct patchwork_rle *p);
+
+/* Libere toute la memoire allouee pour le patchwork p. */
+extern void liberer_patchwork_rle(struct patchwork_rle *p);
+
+#endif /* RLE_H */
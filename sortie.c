@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sortie.h"
+
+/* constantes pour les noms des formats (et extensions des fichiers) */
+static const char *noms_formats[NB_FORMATS] = {
+	"ppm",
+	"qoi",
+	"png"
+};
+
+
+/*---------------------------------------------------------------------------*/
+/*     SORTIE PPM/P6                                                         */
+/*---------------------------------------------------------------------------*/
+
+struct sortie_data {
+	unsigned char *reservee;	/* ligne reservee dans un tampon de l'ecrivain */
+};
+
+
+static void ppm_ecrire_ligne(struct sortie *s, const unsigned char *ligne)
+{
+	size_t taille_ligne = 3 * (size_t) s->largeur;
+
+	// Ligne construite directement dans le tampon de l'ecrivain : rien a copier
+	if (ligne == s->data->reservee) {
+		s->ecrivain->valider(s->ecrivain, taille_ligne);
+		s->data->reservee = NULL;
+	} else {
+		s->ecrivain->ecrire(s->ecrivain, ligne, taille_ligne);
+	}
+}
+
+
+static unsigned char *ppm_tampon_ligne(struct sortie *s)
+{
+	s->data->reservee = s->ecrivain->reserver(s->ecrivain, 3 * (size_t) s->largeur);
+	return s->data->reservee;
+}
+
+
+static void ppm_terminer(struct sortie *s)
+{
+	free(s->data);
+}
+
+
+struct sortie *creer_sortie_ppm(struct ecrivain *e, unsigned int hauteur, unsigned int largeur)
+{
+	struct sortie *s = malloc(sizeof (struct sortie));
+	struct sortie_data *d = calloc(1, sizeof (struct sortie_data));
+
+	if (s == NULL || d == NULL) {
+		free(s);
+		free(d);
+		return NULL;
+	}
+
+	// Initialisation du contenu de la sortie et branchements
+	s->data = d;
+	s->ecrivain = e;
+	s->hauteur = hauteur;
+	s->largeur = largeur;
+	s->indexee = 0;
+	s->ecrire_ligne = &ppm_ecrire_ligne;
+	s->tampon_ligne = &ppm_tampon_ligne;
+	s->terminer = &ppm_terminer;
+
+	// En-tête PPM/P6
+	char entete[64];
+	int n = snprintf(entete, sizeof (entete), "P6\n%u %u\n255\n", largeur, hauteur);
+	e->ecrire(e, entete, (size_t) n);
+
+	return s;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     CREATION ET LIBERATION                                                */
+/*---------------------------------------------------------------------------*/
+
+struct sortie *creer_sortie(const enum format_sortie format, struct ecrivain *e,
+                            unsigned int hauteur, unsigned int largeur,
+                            const struct palette *pal)
+{
+	if (e == NULL)
+		return NULL;
+
+	switch (format) {
+		case FORMAT_PPM:
+			return creer_sortie_ppm(e, hauteur, largeur);
+		case FORMAT_QOI:
+			return creer_sortie_qoi(e, hauteur, largeur);
+		case FORMAT_PNG:
+			return creer_sortie_png(e, hauteur, largeur, pal);
+		default:
+			return NULL;
+	}
+}
+
+
+void fermer_sortie(struct sortie *s)
+{
+	if (s != NULL) {
+		(*(s->terminer))(s);
+		free(s);
+	}
+}
+
+
+enum format_sortie format_depuis_nom(const char *nom)
+{
+	for (int k = 0; k < NB_FORMATS; ++k) {
+		if (strcmp(nom, noms_formats[k]) == 0)
+			return (enum format_sortie) k;
+	}
+
+	return NB_FORMATS;
+}
+
+
+enum format_sortie format_depuis_chemin(const char *chemin)
+{
+	const char *extension = strrchr(chemin, '.');
+	if (extension != NULL) {
+		enum format_sortie format = format_depuis_nom(extension + 1);
+		if (format != NB_FORMATS)
+			return format;
+	}
+
+	return FORMAT_PPM;
+}
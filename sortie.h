@@ -0,0 +1,79 @@
+#ifndef SORTIE_H
+#define SORTIE_H
+
+#include <stdio.h>
+#include "palette.h"
+#include "ecrivain.h"
+
+/* Formats des images produites */
+enum format_sortie {
+	FORMAT_PPM,	/* PPM/P6 brut, 3 octets par pixel */
+	FORMAT_QOI,	/* "Quite OK Image", compresse en flux */
+	FORMAT_PNG,	/* PNG indexe (1, 2, 4 ou 8 bits par pixel) ou RVB */
+	NB_FORMATS	/* sentinelle */
+};
+
+
+/* Structure d'une sortie d'image, alimentee ligne de pixels par ligne de
+ * pixels par le rendu. Comme pour les noeuds de l'AST, la partie data est
+ * privee et propre a chaque format ; les "methodes" sont branchees sur les
+ * fonctions specifiques du format a la creation de la sortie. */
+struct sortie_data;
+
+struct sortie {
+	// donnees privees de l'encodeur
+	struct sortie_data *data;
+
+	struct ecrivain *ecrivain;	/* destination des octets produits */
+	unsigned int hauteur, largeur;	/* en pixels */
+
+	/* vrai si la sortie attend des indices de palette (1 octet par pixel)
+	 * plutot que des triplets RVB */
+	int indexee;
+
+	/* pointeur vers la fonction d'ecriture d'une ligne de largeur pixels RVB
+	 * (3 octets par pixel) ou indices (cf. indexee), les lignes etant
+	 * fournies de haut en bas. */
+	void (*ecrire_ligne) (struct sortie *, const unsigned char *ligne);
+
+	/* pointeur vers la fonction fournissant, si le format le permet, un
+	 * emplacement ou construire directement la prochaine ligne (dans un
+	 * tampon de l'ecrivain) ; la ligne est ensuite passee a ecrire_ligne.
+	 * Retourne NULL si le rendu doit utiliser sa propre ligne. */
+	unsigned char *(*tampon_ligne) (struct sortie *);
+
+	/* pointeur vers la fonction de terminaison du fichier (fin de flux),
+	 * appelee une fois toutes les lignes ecrites ; libere aussi data. */
+	void (*terminer) (struct sortie *);
+};
+
+
+/* Cree et retourne une sortie au format donne, de hauteur x largeur pixels,
+ * ecrivant dans l'ecrivain e ; l'en-tete est ecrit immediatement.
+ * La palette pal (eventuellement NULL) des couleurs de l'image permet aux
+ * formats qui le supportent d'ecrire des indices plutot que des couleurs.
+ * Retourne NULL si le format est inconnu ou si l'allocation echoue. */
+extern struct sortie *creer_sortie(const enum format_sortie format, struct ecrivain *e,
+                                   unsigned int hauteur, unsigned int largeur,
+                                   const struct palette *pal);
+
+/* Termine le flux de la sortie s et libere la memoire associee.
+ * L'ecrivain n'est pas ferme. */
+extern void fermer_sortie(struct sortie *s);
+
+/* Retourne le format de nom nom ("ppm", "qoi", "png"), ou NB_FORMATS. */
+extern enum format_sortie format_depuis_nom(const char *nom);
+
+/* Retourne le format deduit de l'extension du chemin (PPM par defaut). */
+extern enum format_sortie format_depuis_chemin(const char *chemin);
+
+/* Constructeurs specifiques des formats (cf. creer_sortie). */
+extern struct sortie *creer_sortie_ppm(struct ecrivain *e, unsigned int hauteur,
+                                       unsigned int largeur);
+extern struct sortie *creer_sortie_qoi(struct ecrivain *e, unsigned int hauteur,
+                                       unsigned int largeur);
+extern struct sortie *creer_sortie_png(struct ecrivain *e, unsigned int hauteur,
+                                       unsigned int largeur,
+                                       const struct palette *pal);
+
+#endif /* SORTIE_H */
@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L	/* clock_gettime */
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "stats.h"
+
+/* constantes pour l'affichage des noms des phases */
+static const char *noms_phases[NB_PHASES] = {
+	"analyse",
+	"evaluation",
+	"motifs",
+	"rendu"
+};
+
+/* Compteurs de l'execution, et cle des compteurs propres a un fil (creee
+ * par stats_par_fil avant la creation des fils, qui voient donc cle_creee
+ * sans verrou) */
+static struct statistiques globales;
+static pthread_key_t cle_fil;
+static int cle_creee = 0;
+
+
+int stats_par_fil(void)
+{
+	if (!cle_creee && pthread_key_create(&cle_fil, NULL) == 0)
+		cle_creee = 1;
+	return cle_creee ? 0 : -1;
+}
+
+
+struct statistiques *stats_courantes(void)
+{
+	if (!cle_creee)
+		return &globales;
+
+	struct statistiques *propres = pthread_getspecific(cle_fil);
+	return (propres != NULL) ? propres : &globales;
+}
+
+
+void stats_fil(struct statistiques *propres)
+{
+	if (cle_creee)
+		pthread_setspecific(cle_fil, propres);
+}
+
+
+static double maintenant(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+void stats_allocation(size_t octets)
+{
+	stats.allocations++;
+	stats.octets_alloues += octets;
+}
+
+
+void stats_patchwork(long long octets)
+{
+	if (octets > 0)
+		stats.patchworks++;
+
+	stats.memoire_patchworks += octets;
+	if (stats.memoire_patchworks > stats.memoire_patchworks_max)
+		stats.memoire_patchworks_max = stats.memoire_patchworks;
+}
+
+
+void stats_debut(const enum phase p)
+{
+	stats.debuts[p] = maintenant();
+}
+
+
+void stats_fin(const enum phase p)
+{
+	stats.durees[p] += maintenant() - stats.debuts[p];
+}
+
+
+void stats_afficher(FILE *f, int json)
+{
+	if (json) {
+		fprintf(f, "{\"durees_ms\": {");
+		for (int p = 0; p < NB_PHASES; ++p)
+			fprintf(f, "%s\"%s\": %.3f", p ? ", " : "", noms_phases[p], stats.durees[p] * 1e3);
+		fprintf(f, "}, \"noeuds\": %" PRIu64 ", \"patchworks\": %" PRIu64
+		        ", \"cellules_copiees\": %" PRIu64 ", \"plages_copiees\": %" PRIu64
+		        ", \"quadtree_noeuds\": %" PRIu64 ", \"quadtree_partages\": %" PRIu64
+		        ", \"allocations\": %" PRIu64
+		        ", \"octets_alloues\": %" PRIu64 ", \"memoire_patchworks_max\": %" PRIu64
+		        ", \"patchworks_projetes\": %" PRIu64 ", \"octets_projetes\": %" PRIu64
+		        ", \"octets_ecrits\": %" PRIu64 ", \"lignes_reutilisees\": %" PRIu64
+		        ", \"blocs_reutilises\": %" PRIu64 ", \"depot_succes\": %" PRIu64
+		        ", \"depot_echecs\": %" PRIu64 "}\n",
+		        stats.noeuds, stats.patchworks, stats.cellules_copiees, stats.plages_copiees,
+		        stats.quadtree_noeuds, stats.quadtree_partages, stats.allocations,
+		        stats.octets_alloues, stats.memoire_patchworks_max,
+		        stats.patchworks_projetes, stats.octets_projetes, stats.octets_ecrits,
+		        stats.lignes_reutilisees, stats.blocs_reutilises, stats.depot_succes, stats.depot_echecs);
+		return;
+	}
+
+	fprintf(f, ":: Statistiques ::\n");
+	for (int p = 0; p < NB_PHASES; ++p)
+		fprintf(f, "   %-24s %12.3f ms\n", noms_phases[p], stats.durees[p] * 1e3);
+	fprintf(f, "   %-24s %12" PRIu64 "\n", "noeuds", stats.noeuds);
+	fprintf(f, "   %-24s %12" PRIu64 "\n", "patchworks", stats.patchworks);
+	fprintf(f, "   %-24s %12" PRIu64 "\n", "cellules copiees", stats.cellules_copiees);
+	if (stats.plages_copiees > 0)
+		fprintf(f, "   %-24s %12" PRIu64 "\n", "plages copiees", stats.plages_copiees);
+	if (stats.quadtree_noeuds > 0)
+		fprintf(f, "   %-24s %12" PRIu64 " / %" PRIu64 "\n", "noeuds (crees / partages)",
+		        stats.quadtree_noeuds, stats.quadtree_partages);
+	fprintf(f, "   %-24s %12" PRIu64 "\n", "allocations", stats.allocations);
+	fprintf(f, "   %-24s %12" PRIu64 " octets\n", "memoire allouee", stats.octets_alloues);
+	fprintf(f, "   %-24s %12" PRIu64 " octets\n", "pic des patchworks", stats.memoire_patchworks_max);
+	if (stats.patchworks_projetes > 0)
+		fprintf(f, "   %-24s %12" PRIu64 " octets (%" PRIu64 " patchworks)\n", "hors memoire",
+		        stats.octets_projetes, stats.patchworks_projetes);
+	fprintf(f, "   %-24s %12" PRIu64 " octets\n", "sortie", stats.octets_ecrits);
+	fprintf(f, "   %-24s %12" PRIu64 "\n", "lignes reutilisees", stats.lignes_reutilisees);
+	fprintf(f, "   %-24s %12" PRIu64 "\n", "blocs reutilises", stats.blocs_reutilises);
+	if (stats.depot_succes + stats.depot_echecs > 0)
+		fprintf(f, "   %-24s %12" PRIu64 " / %" PRIu64 "\n", "depot (relus / absents)",
+		        stats.depot_succes, stats.depot_echecs);
+}
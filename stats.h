@@ -0,0 +1,72 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Phases chronometrees d'une execution */
+enum phase {
+	PHASE_ANALYSE,
+	PHASE_EVALUATION,
+	PHASE_MOTIFS,
+	PHASE_RENDU,
+	NB_PHASES	/* sentinelle */
+};
+
+/* Compteurs de l'execution. Ils sont tenus en permanence : ce ne sont que
+ * des additions par noeud, par patchwork ou par ecriture (jamais par
+ * pixel), d'un cout negligeable ; seul leur affichage est optionnel. */
+struct statistiques {
+	uint64_t noeuds;		/* noeuds de l'AST crees */
+	uint64_t patchworks;		/* patchworks crees */
+	uint64_t cellules_copiees;	/* primitifs ecrits par les operations */
+	uint64_t plages_copiees;	/* plages ecrites (representation par plages) */
+	uint64_t quadtree_noeuds;	/* noeuds d'arbres quaternaires crees */
+	uint64_t quadtree_partages;	/* noeuds retrouves au lieu d'etre crees */
+	uint64_t allocations;		/* allocations (AST et patchworks) */
+	uint64_t octets_alloues;
+	uint64_t memoire_patchworks;	/* octets des patchworks vivants */
+	uint64_t memoire_patchworks_max;
+	uint64_t patchworks_projetes;	/* patchworks places hors memoire */
+	uint64_t octets_projetes;
+	uint64_t octets_ecrits;		/* octets envoyes aux ecrivains */
+	uint64_t lignes_reutilisees;	/* lignes de pixels reemises sans rendu */
+	uint64_t blocs_reutilises;	/* blocs k x k recopies depuis le cache */
+	uint64_t depot_succes;		/* patchworks relus dans le depot */
+	uint64_t depot_echecs;		/* patchworks absents du depot */
+
+	double durees[NB_PHASES];	/* en secondes */
+	double debuts[NB_PHASES];
+};
+
+/* Compteurs du fil appelant : ceux de l'execution, partages, sauf pour un
+ * fil qui a fixe les siens par stats_fil (les travailleurs du daemon, dont
+ * les requetes sont simultanees). Tous les compteurs s'ecrivent stats.x. */
+extern struct statistiques *stats_courantes(void);
+#define stats (*stats_courantes())
+
+/* Permet a chaque fil d'avoir ses propres compteurs ; a appeler avant la
+ * creation des fils. Retourne 0, ou -1 si c'est impossible. */
+extern int stats_par_fil(void);
+
+/* Les compteurs du fil appelant sont desormais propres, ou ceux de
+ * l'execution si propres est NULL (sans effet sans stats_par_fil). */
+extern void stats_fil(struct statistiques *propres);
+
+/* Comptabilise une allocation de octets octets. */
+extern void stats_allocation(size_t octets);
+
+/* Comptabilise la creation (octets > 0) ou la liberation d'un patchwork
+ * occupant octets octets. */
+extern void stats_patchwork(long long octets);
+
+/* Debut et fin de la phase p (horloge monotone) ; les durees d'une meme
+ * phase s'additionnent. */
+extern void stats_debut(const enum phase p);
+extern void stats_fin(const enum phase p);
+
+/* Affichage des statistiques dans f, en texte ou en JSON. */
+extern void stats_afficher(FILE *f, int json);
+
+#endif /* STATS_H */
@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200809L	/* pwrite, sigaction, nanosleep, st_mtim */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "surveillance.h"
+#include "analyse.h"
+#include "image.h"
+#include "cache.h"
+
+/* Intervalle entre deux consultations du fichier surveille */
+#define INTERVALLE_MS 200
+
+/* Positionne par SIGINT / SIGTERM */
+static volatile sig_atomic_t arret = 0;
+
+static void demander_arret(int signal)
+{
+	(void) signal;
+	arret = 1;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     ECRITURE SUR PLACE                                                    */
+/*---------------------------------------------------------------------------*/
+
+/* Ecriture complete de n octets a la position donnee du fichier. */
+static int ecrire_a(int fd, const unsigned char *octets, size_t n, off_t position)
+{
+	while (n > 0) {
+		ssize_t k = pwrite(fd, octets, n, position);
+		if (k < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		octets += k;
+		position += k;
+		n -= (size_t) k;
+	}
+
+	return 0;
+}
+
+
+/* Deux primitifs sont rendus par la meme tuile. */
+static int primitifs_egaux(const struct primitif *a, const struct primitif *b)
+{
+	return a->nature == b->nature && a->orientation == b->orientation;
+}
+
+
+/* Reecrit dans le fichier fd les pixels du patchwork nouveau qui different
+ * de ceux d'ancien : pour chaque ligne de primitifs, le rectangle couvrant
+ * les colonnes modifiees. Si ancien est NULL ou de dimensions differentes,
+ * le fichier est entierement reecrit (en-tete compris).
+ * Retourne le nombre de primitifs redessines, ou -1 en cas d'erreur. */
+static long redessiner(int fd, const struct patchwork *ancien,
+                       const struct patchwork *nouveau, const struct tuiles *tuiles)
+{
+	const unsigned int cote = tuiles->cote;
+	const size_t largeur_image = (size_t) cote * nouveau->largeur;
+	int complet = (ancien == NULL || ancien->hauteur != nouveau->hauteur
+				   || ancien->largeur != nouveau->largeur);
+
+	char entete[64];
+	int taille_entete = snprintf(entete, sizeof (entete), "P6\n%zu %zu\n255\n",
+								 largeur_image, (size_t) cote * nouveau->hauteur);
+
+	if (complet) {
+		off_t taille = taille_entete + (off_t) largeur_image * cote * nouveau->hauteur * 3;
+		if (ftruncate(fd, taille) != 0
+			|| ecrire_a(fd, (const unsigned char *) entete, taille_entete, 0) != 0)
+			return -1;
+	}
+
+	unsigned char *ligne = malloc(largeur_image * 3);
+	if (ligne == NULL)
+		return -1;
+
+	long redessines = 0;
+	for (uint16_t i = 0; i < nouveau->hauteur; ++i) {
+		const struct primitif *prims = nouveau->primitifs[i];
+		uint16_t jmin = 0, jmax = nouveau->largeur;
+
+		if (!complet) {
+			const struct primitif *anciens = ancien->primitifs[i];
+			while (jmin < jmax && primitifs_egaux(&prims[jmin], &anciens[jmin]))
+				++jmin;
+			while (jmax > jmin && primitifs_egaux(&prims[jmax - 1], &anciens[jmax - 1]))
+				--jmax;
+		}
+
+		if (jmin == jmax)
+			continue;
+
+		uint16_t nb = jmax - jmin;
+		for (unsigned int r = 0; r < cote; ++r) {
+			off_t position = taille_entete
+				+ ((off_t) ((size_t) i * cote + r) * largeur_image + (off_t) jmin * cote) * 3;
+
+			image_ligne_rvb(ligne, prims + jmin, nb, tuiles, r);
+			if (ecrire_a(fd, ligne, (size_t) nb * cote * 3, position) != 0) {
+				free(ligne);
+				return -1;
+			}
+		}
+		redessines += nb;
+	}
+
+	free(ligne);
+	return redessines;
+}
+
+
+/*---------------------------------------------------------------------------*/
+/*     SURVEILLANCE DU FICHIER                                               */
+/*---------------------------------------------------------------------------*/
+
+/* Identite d'une version du fichier surveille : un enregistrement par
+ * renommage change l'inode, un enregistrement sur place la date. */
+struct version {
+	dev_t dev;
+	ino_t ino;
+	off_t taille;
+	struct timespec modification;
+};
+
+static int version_fichier(const char *chemin, struct version *v)
+{
+	struct stat st;
+	if (stat(chemin, &st) != 0)
+		return -1;
+
+	v->dev = st.st_dev;
+	v->ino = st.st_ino;
+	v->taille = st.st_size;
+	v->modification = st.st_mtim;
+	return 0;
+}
+
+static int versions_egales(const struct version *a, const struct version *b)
+{
+	return a->dev == b->dev && a->ino == b->ino && a->taille == b->taille
+		&& a->modification.tv_sec == b->modification.tv_sec
+		&& a->modification.tv_nsec == b->modification.tv_nsec;
+}
+
+
+int surveiller(const char *entree, const char *sortie, const struct tuiles *tuiles)
+{
+	int fd = open(sortie, O_WRONLY | O_CREAT, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", sortie);
+		return EXIT_FAILURE;
+	}
+
+	struct cache *cache = creer_cache();
+	if (cache == NULL) {
+		fprintf(stderr, "ERREUR. Mémoire insuffisante pour le cache.\n");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof (action));
+	action.sa_handler = demander_arret;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	struct noeud_ast *ast = NULL;
+	const struct patchwork *patch = NULL;
+	struct version courante;
+	int a_jour = 0;
+	int code = EXIT_SUCCESS;
+
+	printf(":: Patchwork :: Surveillance de %s (CTRL+C pour arrêter).\n", entree);
+
+	while (!arret) {
+		struct version v;
+		if (version_fichier(entree, &v) != 0 || (a_jour && versions_egales(&v, &courante))) {
+			struct timespec attente = { 0, INTERVALLE_MS * 1000000L };
+			nanosleep(&attente, NULL);
+			continue;
+		}
+		courante = v;
+		a_jour = 1;
+
+		struct noeud_ast *nouvel_ast = analyser_sans_risque(entree);
+		if (nouvel_ast == NULL) {
+			fprintf(stderr, "ERREUR. Expression incorrecte, image inchangée.\n");
+			continue;
+		}
+
+		// Les sous-arbres inchanges sont retrouves dans le cache par leur
+		// empreinte ; seuls les autres sont evalues.
+		unsigned long echecs = cache_echecs(cache);
+		cache_nouvelle_generation(cache);
+		const struct patchwork *nouveau = evaluer_cache(nouvel_ast, cache);
+		unsigned long evalues = cache_echecs(cache) - echecs;
+
+		if (nouveau == NULL) {
+			fprintf(stderr, "ERREUR. L'expression en entrée est incorrecte, image inchangée.\n");
+			liberer_expression(nouvel_ast);
+			continue;	// sans purge : le patchwork affiche reste dans le cache
+		}
+
+		long redessines = (nouveau == patch) ? 0 : redessiner(fd, patch, nouveau, tuiles);
+		if (redessines < 0) {
+			fprintf(stderr, "ERREUR. Écriture impossible : %s.\n", sortie);
+			liberer_expression(nouvel_ast);
+			code = EXIT_FAILURE;
+			break;
+		}
+
+		cache_purger(cache);
+		liberer_expression(ast);
+		ast = nouvel_ast;
+		patch = nouveau;
+
+		printf(":: Patchwork :: %s : %lu sous-arbre(s) évalué(s), %ld primitif(s) "
+			   "redessiné(s) sur %ld.\n", sortie, evalues, redessines,
+			   (long) patch->hauteur * patch->largeur);
+		fflush(stdout);
+	}
+
+	liberer_expression(ast);
+	liberer_cache(cache);
+	if (close(fd) != 0)
+		code = EXIT_FAILURE;
+
+	return code;
+}
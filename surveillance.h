@@ -0,0 +1,17 @@
+#ifndef SURVEILLANCE_H
+#define SURVEILLANCE_H
+
+#include "tuiles.h"
+
+/* Mode surveillance : rend l'expression du fichier entree dans le fichier
+ * PPM/P6 sortie avec les tuiles donnees, puis surveille entree. A chaque
+ * modification, la nouvelle expression est analysee et evaluee en
+ * reutilisant les sous-arbres inchanges (cf. evaluer_cache dans ast.h),
+ * et seuls les rectangles de pixels des primitifs modifies sont reecrits
+ * sur place dans sortie. Une expression incorrecte est signalee et
+ * ignoree ; l'image precedente est conservee.
+ * S'arrete sur SIGINT ou SIGTERM. Retourne EXIT_SUCCESS ou EXIT_FAILURE. */
+extern int surveiller(const char *entree, const char *sortie,
+                      const struct tuiles *tuiles);
+
+#endif /* SURVEILLANCE_H */
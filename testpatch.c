@@ -2,9 +2,55 @@
 #include <argp.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
 #include "ast.h"
 #include "parser.h"
 #include "image.h"
+#include "tuiles.h"
+#include "stats.h"
+#include "surveillance.h"
+#include "progressif.h"
+#include "depot.h"
+#include "demon.h"
+#include "quadtree.h"
+
+/* Taille maximale (de côté) d'un motif, une fois reechantillonné */
+#define TAILLE_MAX_MOTIF 4096
+
+/* Dépôt sur disque : taille maximale (Mio) et taille minimale (en
+ * primitifs) des sous-expressions enregistrées, par défaut */
+#define TAILLE_DEPOT_MIO 1024
+#define SEUIL_DEPOT 16384
+
+/* Mode daemon : travailleurs, mémoire maximale d'une requête et du cache
+ * des sous-expressions (Mio), par défaut */
+#define TRAVAILLEURS_DEMON 4
+#define LIMITE_REQUETE_MIO 512
+#define LIMITE_CACHE_MIO 256
+
+/* Nombre maximal de tailles rendues en une seule exécution */
+#define NB_TAILLES_MAX 16
+
+/* Options sans forme courte */
+enum options_longues {
+	OPT_TAMPONS = 256,
+	OPT_TAILLE_TAMPON,
+	OPT_DIRECT,
+	OPT_STATS,
+	OPT_WATCH,
+	OPT_CACHE,
+	OPT_CACHE_TAILLE,
+	OPT_CACHE_SEUIL,
+	OPT_DAEMON,
+	OPT_TRAVAILLEURS,
+	OPT_LIMITE_MEMOIRE,
+	OPT_MEMOIRE_CACHE,
+	OPT_BLOCS,
+	OPT_REPRESENTATION,
+	OPT_BUDGET_MEMOIRE,
+	OPT_PROGRESSIF
+};
 
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -46,15 +92,74 @@ static char args_doc[] = "";
 
 static struct argp_option options[] = {
 	{ "file", 'f', "exemples_expressions/exemple_sujet", 0, "Chemin vers le fichier d'entrée", 0 },
-	{ "size", 's', "32", 0, "Taille (de côté) d'un motif : 4, 15, 32, 64", 0 },
-	{ "output", 'o', "resultat.ppm", 0, "Chemin vers le patchwork final", 0 },
+	{ "size", 's', "32", 0, "Taille (de côté) d'un motif : 4, 15, 32, 64 ou toute autre taille (motifs reechantillonnés). "
+	                        "Plusieurs tailles séparées par des virgules (ex. 4,15,32,64) sont rendues en un seul passage", 0 },
+	{ "output", 'o', "resultat.ppm", 0, "Chemin vers le patchwork final. Avec plusieurs tailles, %u y est remplacé par "
+	                                    "la taille, ou la taille est ajoutée avant l'extension", 0 },
+	{ "carre", 'c', "FICHIER", 0, "Motif source du carré (reechantillonné à la taille demandée)", 0 },
+	{ "triangle", 't', "FICHIER", 0, "Motif source du triangle (reechantillonné à la taille demandée)", 0 },
+	{ "noyau", 'n', "bilineaire", 0, "Noyau de reechantillonnage : proche, bilineaire", 0 },
+	{ "format", 'F', "ppm", 0, "Format de sortie : ppm, qoi, png (par défaut, selon l'extension de la sortie)", 0 },
+	{ "tampons", OPT_TAMPONS, "4", 0, "Nombre de tampons d'écriture, vidés par un fil dédié pendant le rendu "
+	                                  "(0 : écriture synchrone)", 0 },
+	{ "taille-tampon", OPT_TAILLE_TAMPON, "1024", 0, "Taille d'un tampon d'écriture, en Kio", 0 },
+	{ "direct", OPT_DIRECT, 0, 0, "Ouvrir les sorties avec O_DIRECT (contourne le cache de pages)", 0 },
+	{ "stats", OPT_STATS, "json", OPTION_ARG_OPTIONAL, "Afficher (sur la sortie d'erreur) les durées des phases, "
+	                                                   "les compteurs et le pic mémoire, en texte ou en JSON", 0 },
+	{ "watch", OPT_WATCH, 0, 0, "Surveiller le fichier d'entrée et, à chaque modification, ne réévaluer que les "
+	                           "sous-expressions modifiées et ne réécrire que les pixels changés (PPM, une taille)", 0 },
+	{ "progressif", OPT_PROGRESSIF, 0, 0, "Écrire d'abord un aperçu (chaque primitif de la couleur moyenne de sa "
+	                                     "tuile), puis l'affiner sur place, du centre vers les bords ; "
+	                                     "l'avancement est noté dans <sortie>.progression (PPM, une taille)", 0 },
+	{ "cache", OPT_CACHE, "DOSSIER", 0, "Dépôt sur disque des sous-expressions évaluées, relues au lieu d'être "
+	                                    "réévaluées d'une exécution à l'autre", 0 },
+	{ "cache-taille", OPT_CACHE_TAILLE, "1024", 0, "Taille maximale du dépôt, en Mio (les fichiers les moins "
+	                                               "récemment utilisés sont supprimés au-delà)", 0 },
+	{ "cache-seuil", OPT_CACHE_SEUIL, "16384", 0, "Nombre minimal de primitifs d'une sous-expression pour "
+	                                              "qu'elle soit cherchée dans le dépôt et enregistrée", 0 },
+	{ "blocs", OPT_BLOCS, "K", 0, "Rendre par blocs de K x K primitifs (2 à 16), les blocs répétés étant recopiés "
+	                              "depuis un cache des blocs rendus (0 : rendu par lignes)", 0 },
+	{ "representation", OPT_REPRESENTATION, "grille", 0, "Représentation des patchworks : grille (un élément par "
+	                                                     "primitif), plages (suites de primitifs identiques "
+	                                                     "d'une ligne) ou quadtree (arbre quaternaire aux "
+	                                                     "sous-arbres identiques partagés)", 0 },
+	{ "budget-memoire", OPT_BUDGET_MEMOIRE, "MIO", 0, "Mémoire maximale des patchworks en Mio, au-delà de laquelle "
+	                                                 "ils sont placés dans des fichiers temporaires projetés "
+	                                                 "($TMPDIR) (0 : illimitée ; par défaut, la moitié de la "
+	                                                 "mémoire physique)", 0 },
+	{ "daemon", OPT_DAEMON, "SOCKET", 0, "Servir les rendus demandés sur la socket Unix donnée (cf. clientpatch), "
+	                                    "motifs et sous-expressions restant en mémoire entre les requêtes", 0 },
+	{ "travailleurs", OPT_TRAVAILLEURS, "4", 0, "Mode daemon : nombre de requêtes servies simultanément", 0 },
+	{ "limite-memoire", OPT_LIMITE_MEMOIRE, "512", 0, "Mode daemon : mémoire maximale d'une requête, en Mio", 0 },
+	{ "memoire-cache", OPT_MEMOIRE_CACHE, "256", 0, "Mode daemon : mémoire du cache des sous-expressions, en Mio", 0 },
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
 struct arguments {
   char *output;
   char *input;
-  uintmax_t size;
+  uintmax_t sizes[NB_TAILLES_MAX];
+  int nb_sizes;
+  char *carre;
+  char *triangle;
+  enum noyau_reechantillonnage noyau;
+  enum format_sortie format;
+  uintmax_t tampons;
+  uintmax_t taille_tampon;
+  int direct;
+  int afficher_stats;	/* 0 : aucune, 1 : texte, 2 : JSON */
+  int watch;
+  int progressif;
+  char *cache;
+  uintmax_t cache_taille;
+  uintmax_t cache_seuil;
+  uintmax_t blocs;
+  enum representation representation;
+  uintmax_t budget_memoire;	/* en Mio, UINTMAX_MAX : par défaut */
+  char *daemon;
+  uintmax_t travailleurs;
+  uintmax_t limite_memoire;
+  uintmax_t memoire_cache;
 };
 
 static error_t parse_opt (int key, char *arg, struct argp_state *state) {
@@ -68,20 +173,132 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
 			arguments->input = arg;
 			break;
 		case 's':
-			arguments->size = strtoumax(arg, NULL, 10);
-			if (arguments->size == UINTMAX_MAX && errno == ERANGE)
-				argp_usage (state);
+			arguments->nb_sizes = 0;
+			do {
+				char *fin;
+				uintmax_t size = strtoumax(arg, &fin, 10);
+				if (size == UINTMAX_MAX && errno == ERANGE)
+					argp_usage (state);
+
+				if (fin == arg || size == 0 || size > TAILLE_MAX_MOTIF
+					|| arguments->nb_sizes == NB_TAILLES_MAX
+					|| (*fin != ',' && *fin != '\0'))
+					argp_usage (state);
 
-			if (arguments->size != 4
-				&& arguments->size != 15
-				&& arguments->size != 32
-				&& arguments->size != 64)
+				arguments->sizes[arguments->nb_sizes++] = size;
+				arg = (*fin == ',') ? fin + 1 : fin;
+			} while (*arg != '\0');
+			break;
+		case 'c':
+			arguments->carre = arg;
+			break;
+		case 't':
+			arguments->triangle = arg;
+			break;
+		case 'n':
+			arguments->noyau = noyau_depuis_nom(arg);
+			if (arguments->noyau == NB_NOYAUX)
 				argp_usage (state);
 			break;
+		case 'F':
+			arguments->format = format_depuis_nom(arg);
+			if (arguments->format == NB_FORMATS)
+				argp_usage (state);
+			break;
+		case OPT_TAMPONS:
+			arguments->tampons = strtoumax(arg, NULL, 10);
+			if (arguments->tampons == 1 || arguments->tampons > 1024)
+				argp_usage (state);
+			break;
+		case OPT_TAILLE_TAMPON:
+			arguments->taille_tampon = strtoumax(arg, NULL, 10);
+			if (arguments->taille_tampon == 0 || arguments->taille_tampon > 1024 * 1024)
+				argp_usage (state);
+			break;
+		case OPT_DIRECT:
+			arguments->direct = 1;
+			break;
+		case OPT_STATS:
+			if (arg == NULL)
+				arguments->afficher_stats = 1;
+			else if (strcmp(arg, "json") == 0)
+				arguments->afficher_stats = 2;
+			else
+				argp_usage (state);
+			break;
+		case OPT_WATCH:
+			arguments->watch = 1;
+			break;
+		case OPT_PROGRESSIF:
+			arguments->progressif = 1;
+			break;
+		case OPT_CACHE:
+			arguments->cache = arg;
+			break;
+		case OPT_CACHE_TAILLE:
+			arguments->cache_taille = strtoumax(arg, NULL, 10);
+			if (arguments->cache_taille == 0 || arguments->cache_taille > UINT64_MAX >> 20)
+				argp_usage (state);
+			break;
+		case OPT_CACHE_SEUIL:
+			arguments->cache_seuil = strtoumax(arg, NULL, 10);
+			if (arguments->cache_seuil == 0)
+				argp_usage (state);
+			break;
+		case OPT_BLOCS:
+			arguments->blocs = strtoumax(arg, NULL, 10);
+			if (arguments->blocs == 1 || arguments->blocs > 16)
+				argp_usage (state);
+			break;
+		case OPT_REPRESENTATION:
+			arguments->representation = representation_depuis_nom(arg);
+			if (arguments->representation == NB_REPRESENTATIONS)
+				argp_usage (state);
+			break;
+		case OPT_BUDGET_MEMOIRE:
+			arguments->budget_memoire = strtoumax(arg, NULL, 10);
+			if (arguments->budget_memoire > UINT64_MAX >> 20)
+				argp_usage (state);
+			break;
+		case OPT_DAEMON:
+			arguments->daemon = arg;
+			break;
+		case OPT_TRAVAILLEURS:
+			arguments->travailleurs = strtoumax(arg, NULL, 10);
+			if (arguments->travailleurs == 0 || arguments->travailleurs > 256)
+				argp_usage (state);
+			break;
+		case OPT_LIMITE_MEMOIRE:
+		case OPT_MEMOIRE_CACHE:
+			{
+				uintmax_t mio = strtoumax(arg, NULL, 10);
+				if (mio == 0 || mio > UINT64_MAX >> 20)
+					argp_usage (state);
+				if (key == OPT_LIMITE_MEMOIRE)
+					arguments->limite_memoire = mio;
+				else
+					arguments->memoire_cache = mio;
+			}
+			break;
 		case ARGP_KEY_END:
 			if (state->arg_num > 0) {
 				argp_usage (state);
 			}
+			if (arguments->watch && (arguments->input == NULL || arguments->nb_sizes != 1)) {
+				argp_error (state, "--watch demande un fichier d'entrée (-f) et une seule taille");
+			}
+			if (arguments->progressif
+				&& (arguments->nb_sizes != 1 || arguments->representation != GRILLE
+					|| arguments->blocs != 0 || arguments->watch || arguments->daemon != NULL)) {
+				argp_error (state, "--progressif demande une seule taille et la représentation grille, "
+							"sans --blocs, --watch ni --daemon");
+			}
+			if (arguments->representation != GRILLE
+				&& (arguments->cache != NULL || arguments->blocs != 0
+					|| arguments->watch || arguments->daemon != NULL)) {
+				argp_error (state, "--representation plages ou quadtree ne se combine pas avec "
+							"--cache, --blocs, --watch ni --daemon");
+			}
 			break;
 		default:
 	      return ARGP_ERR_UNKNOWN;
@@ -92,6 +309,65 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
 
 static struct argp arg_p = { options, parse_opt, args_doc, doc, 0, 0, 0 };
 
+/*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+// Chemins des sorties
+
+/* Chemin de sortie pour la taille donnée, lorsque plusieurs tailles sont
+ * rendues : le modèle peut contenir %u, sinon "_taille" est inséré avant
+ * l'extension (resultat.ppm -> resultat_32.ppm). */
+static void chemin_sortie(char *chemin, size_t taille_chemin, const char *modele,
+                          unsigned int taille)
+{
+	const char *marque = strstr(modele, "%u");
+	if (marque != NULL) {
+		snprintf(chemin, taille_chemin, "%.*s%u%s", (int) (marque - modele),
+				 modele, taille, marque + 2);
+		return;
+	}
+
+	const char *extension = strrchr(modele, '.');
+	const char *dossier = strrchr(modele, '/');
+	if (extension == NULL || (dossier != NULL && extension < dossier))
+		extension = modele + strlen(modele);
+
+	snprintf(chemin, taille_chemin, "%.*s_%u%s", (int) (extension - modele),
+			 modele, taille, extension);
+}
+
+/* Ouverture de la destination d'une image : écriture asynchrone par
+ * tampons si demandée, sinon simple FILE * (stdio). */
+static struct ecrivain *ouvrir_ecrivain(const char *chemin, const struct arguments *arguments)
+{
+	if (arguments->tampons >= 2)
+		return creer_ecrivain_asynchrone(chemin, (unsigned int) arguments->tampons,
+										 (size_t) arguments->taille_tampon * 1024,
+										 arguments->direct);
+
+	FILE *f = fopen(chemin, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "ERREUR. Impossible d'ouvrir : %s.\n", chemin);
+		return NULL;
+	}
+
+	struct ecrivain *e = creer_ecrivain_fichier(f);
+	if (e == NULL)
+		fclose(f);
+	return e;
+}
+
+/* Budget de mémoire des patchworks par défaut : la moitié de la mémoire
+ * physique (illimité si elle est inconnue). */
+static uint64_t budget_par_defaut(void)
+{
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long taille_page = sysconf(_SC_PAGESIZE);
+	if (pages <= 0 || taille_page <= 0)
+		return 0;
+
+	return (uint64_t) pages * (uint64_t) taille_page / 2;
+}
+
 /*---------------------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 
@@ -100,40 +376,196 @@ int main(int argc, char **argv)
 	struct arguments arguments;
 	arguments.input = NULL;
 	arguments.output = "resultat.ppm";
-	arguments.size = 32;
+	arguments.sizes[0] = 32;
+	arguments.nb_sizes = 1;
+	arguments.carre = NULL;
+	arguments.triangle = NULL;
+	arguments.noyau = BILINEAIRE;
+	arguments.format = NB_FORMATS;
+	arguments.tampons = 4;
+	arguments.taille_tampon = 1024;
+	arguments.direct = 0;
+	arguments.afficher_stats = 0;
+	arguments.watch = 0;
+	arguments.progressif = 0;
+	arguments.cache = NULL;
+	arguments.cache_taille = TAILLE_DEPOT_MIO;
+	arguments.cache_seuil = SEUIL_DEPOT;
+	arguments.blocs = 0;
+	arguments.representation = GRILLE;
+	arguments.budget_memoire = UINTMAX_MAX;
+	arguments.daemon = NULL;
+	arguments.travailleurs = TRAVAILLEURS_DEMON;
+	arguments.limite_memoire = LIMITE_REQUETE_MIO;
+	arguments.memoire_cache = LIMITE_CACHE_MIO;
 
 	/* Valeurs par défaut des arguments. */
 
 	argp_parse (&arg_p, argc, argv, 0, 0, &arguments);
+	if (arguments.format == NB_FORMATS)
+		arguments.format = format_depuis_chemin(arguments.output);
+
+	// Au-delà du budget, les patchworks sont placés hors mémoire plutôt que
+	// d'épuiser la mémoire physique
+	if (arguments.budget_memoire == UINTMAX_MAX)
+		fixer_budget_patchworks(budget_par_defaut());
+	else
+		fixer_budget_patchworks((uint64_t) arguments.budget_memoire << 20);
+
+	// Mode daemon : les requêtes fixent expression, taille et format
+	if (arguments.daemon != NULL) {
+		struct config_demon config = {
+			arguments.carre, arguments.triangle, arguments.noyau,
+			(unsigned int) arguments.travailleurs,
+			(uint64_t) arguments.limite_memoire << 20,
+			(uint64_t) arguments.memoire_cache << 20
+		};
+		return servir(arguments.daemon, &config);
+	}
+
+	// Mode surveillance : l'image est mise à jour à chaque modification de l'entrée
+	if (arguments.watch) {
+		if (arguments.format != FORMAT_PPM) {
+			fprintf(stderr, "ERREUR. --watch ne produit que du PPM.\n");
+			return EXIT_FAILURE;
+		}
+
+		unsigned int taille = (unsigned int) arguments.sizes[0];
+		char chaine_carre[256];
+		char chaine_triangle[256];
+		chemin_motif(chaine_carre, sizeof (chaine_carre), arguments.carre, "carre", taille);
+		chemin_motif(chaine_triangle, sizeof (chaine_triangle), arguments.triangle,
+					 "triangle", taille);
+
+		struct tuiles *tuiles = charger_tuiles(chaine_carre, chaine_triangle, taille,
+											   arguments.noyau);
+		if (tuiles == NULL)
+			return EXIT_FAILURE;
+
+		int code = surveiller(arguments.input, arguments.output, tuiles);
+		liberer_tuiles(tuiles);
+		return code;
+	}
+
+	if (arguments.progressif && arguments.format != FORMAT_PPM) {
+		fprintf(stderr, "ERREUR. --progressif ne produit que du PPM.\n");
+		return EXIT_FAILURE;
+	}
+
 	struct noeud_ast *noeud_analyseur;
 
 	// Si pas de -f, on prend le flux clavier
 	if (arguments.input == NULL) {
 		printf(":: Patchwork :: CTRL+D pour lancer la création du patchwork.\n");
+		stats_debut(PHASE_ANALYSE);
 		analyser(NULL, &noeud_analyseur);
 	} else {
 		printf(":: Patchwork :: Génération depuis %s.\n", arguments.input);
+		stats_debut(PHASE_ANALYSE);
 		analyser((unsigned char *) arguments.input, &noeud_analyseur);
 	}
+	stats_fin(PHASE_ANALYSE);
 
 	// Génération du patchwork à partir de l'arbre syntaxique abstrait de l'expression
-	struct patchwork *patch = noeud_analyseur->evaluer(noeud_analyseur);
+	// Avec un dépôt, les grandes sous-expressions déjà évaluées sont relues
+	stats_debut(PHASE_EVALUATION);
+	struct patchwork *patch = NULL;
+	struct patchwork_rle *rle = NULL;
+	struct patchwork_qt *qt = NULL;
+	struct depot *depot = NULL;
+	if (arguments.representation == PLAGES) {
+		rle = evaluer_rle(noeud_analyseur);
+	} else if (arguments.representation == QUADTREE) {
+		qt = evaluer_qt(noeud_analyseur);
+	} else if (arguments.cache != NULL
+		&& (depot = ouvrir_depot(arguments.cache, (uint64_t) arguments.cache_taille << 20)) != NULL) {
+		patch = evaluer_depot(noeud_analyseur, depot, arguments.cache_seuil);
+		fermer_depot(depot);
+	} else {
+		patch = noeud_analyseur->evaluer(noeud_analyseur);
+	}
+	stats_fin(PHASE_EVALUATION);
+
+	// Création des images. L'argument de sortie par défaut est <resultat.ppm>
+	// Le patchwork, évalué une seule fois, est rendu à toutes les tailles
+	// demandées en un seul parcours de sa grille.
+	int nb = arguments.nb_sizes;
+	struct tuiles *tuiles[NB_TAILLES_MAX];
+	struct ecrivain *sorties[NB_TAILLES_MAX];
+	char noms[NB_TAILLES_MAX][256];
+	const char *noms_sorties[NB_TAILLES_MAX];
+	int ok = 1;
+
+	// Patchwork de la représentation demandée : NULL si l'expression est incorrecte
+	int evalue = (arguments.representation == PLAGES) ? rle != NULL
+			   : (arguments.representation == QUADTREE) ? qt != NULL
+			   : patch != NULL;
+
+	stats_debut(PHASE_MOTIFS);
+	for (int k = 0; k < nb; ++k) {
+		unsigned int taille = (unsigned int) arguments.sizes[k];
+		char chaine_carre[256];
+		char chaine_triangle[256];
+
+		chemin_motif(chaine_carre, sizeof (chaine_carre), arguments.carre,
+					 "carre", taille);
+		chemin_motif(chaine_triangle, sizeof (chaine_triangle), arguments.triangle,
+					 "triangle", taille);
 
-	// Création de l'image. L'argument de sortie par défaut est <resultat.ppm>
-	char chaine_carre[100];
-	char chaine_triangle[100];
+		if (nb == 1)
+			snprintf(noms[k], sizeof (noms[k]), "%s", arguments.output);
+		else
+			chemin_sortie(noms[k], sizeof (noms[k]), arguments.output, taille);
+		noms_sorties[k] = noms[k];
 
-	sprintf(chaine_carre, "motifs/carre_%u.ppm", (unsigned int) arguments.size);
-	sprintf(chaine_triangle, "motifs/triangle_%u.ppm", (unsigned int) arguments.size);
+		// Les tuiles orientées sont calculées une seule fois pour tout le rendu
+		tuiles[k] = charger_tuiles(chaine_carre, chaine_triangle, taille,
+								   arguments.noyau);
+		sorties[k] = NULL;
+		if (tuiles[k] == NULL)
+			ok = 0;
+	}
+	stats_fin(PHASE_MOTIFS);
 
-	// char chaine_triangle[] = "motifs/carre_32.ppm";
+	// En mode progressif, l'image est écrite sur place et non par un écrivain
+	for (int k = 0; ok && !arguments.progressif && k < nb; ++k) {
+		if ((sorties[k] = ouvrir_ecrivain(noms[k], &arguments)) == NULL)
+			ok = 0;
+	}
 
-	creer_image(patch, chaine_carre, chaine_triangle,
-				fopen(arguments.output, "wb"), arguments.output);
+	if (ok) {
+		stats_debut(PHASE_RENDU);
+		if (arguments.progressif)
+			ok = (rendre_progressif(patch, noms[0], tuiles[0]) == 0);
+		else if (arguments.representation == PLAGES)
+			ok = (creer_images_tuiles_rle(rle, (const struct tuiles **) tuiles, sorties,
+										  noms_sorties, nb, arguments.format) == 0);
+		else if (arguments.representation == QUADTREE)
+			ok = (creer_images_tuiles_qt(qt, (const struct tuiles **) tuiles, sorties,
+										 noms_sorties, nb, arguments.format) == 0);
+		else
+			ok = (creer_images_tuiles(patch, (const struct tuiles **) tuiles, sorties,
+									  noms_sorties, nb, arguments.format,
+									  (unsigned int) arguments.blocs) == 0);
+		stats_fin(PHASE_RENDU);
+	} else {
+		for (int k = 0; k < nb; ++k) {
+			if (sorties[k] != NULL)
+				sorties[k]->fermer(sorties[k]);
+		}
+	}
 
 	// Libération de la mémoire
+	for (int k = 0; k < nb; ++k)
+		liberer_tuiles(tuiles[k]);
 	liberer_expression(noeud_analyseur);
 	liberer_patchwork(patch);
+	liberer_patchwork_rle(rle);
+	liberer_patchwork_qt(qt);
+	vider_quadtrees();
+
+	if (arguments.afficher_stats)
+		stats_afficher(stderr, arguments.afficher_stats == 2);
 
 	// printf ("ARG1 = %s\nARG2 = %s\nOUTPUT_FILE = %s\n"
 	//           "SILENT = %s\n",
@@ -165,5 +597,5 @@ int main(int argc, char **argv)
 	//
 	// liberer_expression(noeud_analyseur);
 	// liberer_patchwork(patch);
-	return EXIT_SUCCESS;
+	return ok && evalue ? EXIT_SUCCESS : EXIT_FAILURE;
 }
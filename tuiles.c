@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tuiles.h"
+
+/* Taille des motifs servant de source au reechantillonnage */
+#define TAILLE_MOTIF_SOURCE 64
+
+
+/* Copie d'un motif de taille cote en un bloc RVB contigu. */
+static unsigned char *copier_motif(const struct motif *m)
+{
+	unsigned char *res = malloc(3 * (size_t) m->hauteur * m->largeur);
+	if (res == NULL)
+		return NULL;
+
+	for (unsigned int i = 0; i < m->hauteur; ++i) {
+		for (unsigned int j = 0; j < m->largeur; ++j) {
+			unsigned char *p = res + 3 * ((size_t) i * m->largeur + j);
+			p[0] = m->pixels[i][j].R;
+			p[1] = m->pixels[i][j].V;
+			p[2] = m->pixels[i][j].B;
+		}
+	}
+
+	return res;
+}
+
+
+/* Construction de la tuile d'orientation o a partir de la tuile EST.
+ * Les correspondances de pixels sont celles du rendu pixel par pixel
+ * historique (cf. ppm_pixel), afin de produire des images identiques. */
+static void orienter(unsigned char *dst, const unsigned char *est,
+                     unsigned int cote, enum orientation_primitif o)
+{
+	for (unsigned int i = 0; i < cote; ++i) {
+		for (unsigned int j = 0; j < cote; ++j) {
+			unsigned int draw_i, draw_j;
+
+			switch (o) {
+				case NORD:
+					draw_i = j;
+					draw_j = cote - i - 1;
+					break;
+				case OUEST:
+					draw_i = j;
+					draw_j = i;
+					break;
+				case SUD:
+					draw_i = cote - j - 1;
+					draw_j = i;
+					break;
+				default:
+					draw_i = i;
+					draw_j = j;
+					break;
+			}
+
+			memcpy(dst + 3 * ((size_t) i * cote + j),
+			       est + 3 * ((size_t) draw_i * cote + draw_j), 3);
+		}
+	}
+}
+
+
+/* Construction de la palette des tuiles et des tuiles indexees.
+ * Les orientations ne changent pas les couleurs : seules les tuiles EST
+ * sont parcourues pour la palette. */
+static int indexer_tuiles(struct tuiles *t)
+{
+	size_t nb_pixels = (size_t) t->cote * t->cote;
+
+	palette_vider(&t->palette);
+	for (int nat = 0; nat < NB_NAT_PRIMITIFS; ++nat) {
+		for (size_t p = 0; p < nb_pixels; ++p) {
+			if (palette_indice(&t->palette, t->rvb[nat][EST] + 3 * p) < 0)
+				return 1;	// Trop de couleurs : pas de sortie indexee
+		}
+	}
+
+	for (int nat = 0; nat < NB_NAT_PRIMITIFS; ++nat) {
+		for (int o = 0; o < NB_ORIENTATIONS; ++o) {
+			t->indices[nat][o] = malloc(nb_pixels);
+			if (t->indices[nat][o] == NULL)
+				return 0;
+
+			for (size_t p = 0; p < nb_pixels; ++p)
+				t->indices[nat][o][p] = (unsigned char) palette_indice(&t->palette, t->rvb[nat][o] + 3 * p);
+		}
+	}
+
+	return 1;
+}
+
+
+struct tuiles *creer_tuiles(const struct motif *carre,
+                            const struct motif *triangle,
+                            unsigned int cote,
+                            enum noyau_reechantillonnage noyau)
+{
+	const struct motif *motifs[NB_NAT_PRIMITIFS] = { carre, triangle };
+
+	if (cote == 0)
+		return NULL;
+
+	struct tuiles *t = calloc(1, sizeof (struct tuiles));
+	if (t == NULL)
+		return NULL;
+	t->cote = cote;
+
+	for (int nat = 0; nat < NB_NAT_PRIMITIFS; ++nat) {
+		const struct motif *m = motifs[nat];
+		unsigned char *est;
+
+		// Pas de reechantillonnage si le motif a deja la bonne taille
+		if (m->hauteur == cote && m->largeur == cote)
+			est = copier_motif(m);
+		else
+			est = reechantillonner(m, cote, noyau);
+
+		if (est == NULL) {
+			liberer_tuiles(t);
+			return NULL;
+		}
+
+		t->rvb[nat][EST] = est;
+		for (int o = NORD; o < NB_ORIENTATIONS; ++o) {
+			t->rvb[nat][o] = malloc(3 * (size_t) cote * cote);
+			if (t->rvb[nat][o] == NULL) {
+				liberer_tuiles(t);
+				return NULL;
+			}
+			orienter(t->rvb[nat][o], est, cote, (enum orientation_primitif) o);
+		}
+	}
+
+	if (!indexer_tuiles(t)) {
+		liberer_tuiles(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+
+struct tuiles *charger_tuiles(const char *fichier_carre,
+                              const char *fichier_triangle,
+                              unsigned int cote,
+                              enum noyau_reechantillonnage noyau)
+{
+	struct motif carre, triangle;
+
+	if (motif_charger(fichier_carre, &carre) < 1) {
+		fprintf(stderr, "ERREUR. Motif incorrect : %s.\n", fichier_carre);
+		return NULL;
+	}
+
+	if (motif_charger(fichier_triangle, &triangle) < 1) {
+		fprintf(stderr, "ERREUR. Motif incorrect : %s.\n", fichier_triangle);
+		ppm_liberer(carre);
+		return NULL;
+	}
+
+	struct tuiles *t = creer_tuiles(&carre, &triangle, cote, noyau);
+	if (t == NULL)
+		fprintf(stderr, "ERREUR. Impossible de construire les tuiles de taille %u.\n", cote);
+
+	ppm_liberer(carre);
+	ppm_liberer(triangle);
+
+	return t;
+}
+
+
+void liberer_tuiles(struct tuiles *t)
+{
+	if (t != NULL) {
+		for (int nat = 0; nat < NB_NAT_PRIMITIFS; ++nat) {
+			for (int o = 0; o < NB_ORIENTATIONS; ++o) {
+				free(t->rvb[nat][o]);
+				free(t->indices[nat][o]);
+			}
+		}
+
+		free(t);
+	}
+}
+
+
+static int fichier_existe(const char *chemin)
+{
+	FILE *f = fopen(chemin, "rb");
+	if (f == NULL)
+		return 0;
+
+	fclose(f);
+	return 1;
+}
+
+
+/* Le fichier choisi par l'utilisateur, sinon le motif pre-calcule a cette
+ * taille s'il existe, sinon le motif source de plus grande taille, qui
+ * sera reechantillonne. */
+void chemin_motif(char *chemin, size_t taille_chemin, const char *choisi,
+                  const char *nom, unsigned int taille)
+{
+	if (choisi != NULL) {
+		snprintf(chemin, taille_chemin, "%s", choisi);
+		return;
+	}
+
+	snprintf(chemin, taille_chemin, "motifs/%s_%u.ppm", nom, taille);
+	if (!fichier_existe(chemin))
+		snprintf(chemin, taille_chemin, "motifs/%s_%u.ppm", nom, TAILLE_MOTIF_SOURCE);
+}
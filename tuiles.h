@@ -0,0 +1,50 @@
+#ifndef TUILES_H
+#define TUILES_H
+
+#include "patchwork.h"
+#include "motif.h"
+#include "reechantillonnage.h"
+#include "palette.h"
+
+/* Cache des tuiles orientees : pour chaque nature et chaque orientation
+ * de primitif, le bloc RVB de cote x cote pixels tel qu'il doit apparaitre
+ * dans l'image finale. Les tuiles sont calculees une seule fois par
+ * execution ; le rendu se ramene alors a des copies de lignes de tuiles. */
+struct tuiles {
+	unsigned int cote;
+	unsigned char *rvb[NB_NAT_PRIMITIFS][NB_ORIENTATIONS];	/* cote * cote * 3 octets */
+
+	/* Palette des couleurs des deux motifs, construite au chargement, et
+	 * tuiles equivalentes en indices de cette palette (cote * cote octets).
+	 * Les indices sont NULL si la palette est pleine. */
+	struct palette palette;
+	unsigned char *indices[NB_NAT_PRIMITIFS][NB_ORIENTATIONS];
+};
+
+/* Cree et retourne les tuiles de cote pixels construites a partir des
+ * motifs carre et triangle, reechantillonnes avec le noyau donne si leur
+ * taille differe de cote.
+ * Retourne NULL en cas d'echec. */
+extern struct tuiles *creer_tuiles(const struct motif *carre,
+                                   const struct motif *triangle,
+                                   unsigned int cote,
+                                   enum noyau_reechantillonnage noyau);
+
+/* Cree et retourne les tuiles de cote pixels a partir des fichiers PPM/P6
+ * fichier_carre et fichier_triangle (cf. creer_tuiles).
+ * Retourne NULL en cas d'echec, apres affichage d'un message. */
+extern struct tuiles *charger_tuiles(const char *fichier_carre,
+                                     const char *fichier_triangle,
+                                     unsigned int cote,
+                                     enum noyau_reechantillonnage noyau);
+
+/* Libere toute la memoire allouee pour les tuiles t. */
+extern void liberer_tuiles(struct tuiles *t);
+
+/* Ecrit dans chemin le fichier du motif de nom nom ("carre", "triangle")
+ * a utiliser pour des tuiles de taille pixels : choisi s'il n'est pas NULL,
+ * sinon un motif du dossier motifs/. */
+extern void chemin_motif(char *chemin, size_t taille_chemin, const char *choisi,
+                         const char *nom, unsigned int taille);
+
+#endif /* TUILES_H */